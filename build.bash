@@ -9,5 +9,6 @@ std=c99
 
 $compiler $src -std=$std $olvl $libs $flags -o $output -g -fsanitize=address -fno-omit-frame-pointer
 
+./chip8 -test || exit 1
 ./chip8 ./res/PONG
 rm ./chip8
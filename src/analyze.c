@@ -0,0 +1,330 @@
+#include "analyze.h"
+#include "chip8.h"
+#include "opcode.h"
+#include "utility.h"
+#include <stdio.h> // printf
+#include <stdlib.h> // free
+#include <string.h> // memset
+
+#define MAX_ENTRIES 4096 // one per byte of the address space
+
+// What is known about V and I at a point inside a basic block.
+typedef struct
+{
+    bool v_known[16];
+    u8   v[16];
+    bool i_known;
+    u16  i;
+} Consts;
+
+static u16 fetch(u8* memory, u16 addr) { return memory[addr] << 8 | memory[addr + 1]; }
+
+static void push(RomAnalysis* a, u16* work, s32* count, u16 addr, u8 flag)
+{
+    if (addr >= 4095) return;
+    a->flags[addr] |= BYTE_LEADER | flag;
+    if (!(a->flags[addr] & BYTE_CODE) && *count < MAX_ENTRIES) work[(*count)++] = addr;
+}
+
+//------------------------------------------------------------------------------
+//                               Reachability
+//------------------------------------------------------------------------------
+
+// Walks every path from the addresses in 'work', marking the instructions it
+// passes through as code and the start of every block as a leader.
+static void discover(RomAnalysis* a, u8* memory, u16* work, s32 count)
+{
+    while (count > 0) {
+        u16 addr = work[--count];
+
+        while (addr < 4095 && !(a->flags[addr] & BYTE_CODE)) {
+            u16    op   = fetch(memory, addr);
+            OpKind kind = decodeOpcode(op, a->profile);
+            u32    f    = op_info[kind].flags;
+            if (kind == OP_UNKNOWN) break;
+
+            a->flags[addr] |= BYTE_CODE;
+            a->flags[addr + 1] |= BYTE_CODE;
+
+            if (f & OPF_INDIRECT) break; // resolved later, if at all
+            if (f & OPF_RETURN) break;
+            if (f & OPF_JUMP) {
+                push(a, work, &count, OP_NNN(op), BYTE_JUMP_TARGET);
+                break;
+            }
+            if (f & OPF_CALL) {
+                push(a, work, &count, OP_NNN(op), BYTE_CALL_TARGET);
+                if (addr + 2 < 4096) a->flags[addr + 2] |= BYTE_LEADER;
+            }
+            if (f & OPF_SKIP) {
+                push(a, work, &count, addr + 4, 0);
+                if (addr + 2 < 4096) a->flags[addr + 2] |= BYTE_LEADER;
+            }
+            addr += 2;
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+//                               Constant Tracking
+//------------------------------------------------------------------------------
+
+static void step(Consts* c, u16 op, QuirkProfile profile)
+{
+    u8 x = OP_X(op), y = OP_Y(op);
+
+    switch (decodeOpcode(op, profile)) {
+    case OP_LD_BYTE:
+        c->v_known[x] = true;
+        c->v[x]       = OP_NN(op);
+        break;
+    case OP_ADD_BYTE: c->v[x] += OP_NN(op); break;
+    case OP_LD_REG:
+        c->v_known[x] = c->v_known[y];
+        c->v[x]       = c->v[y];
+        break;
+    case OP_OR:
+    case OP_AND:
+    case OP_XOR:
+    case OP_RND:
+    case OP_LD_VX_DT:
+    case OP_LD_KEY: c->v_known[x] = false; break;
+    case OP_LOAD_FLAGS:
+        for (s32 i = 0; i <= x; ++i)
+            c->v_known[i] = false;
+        break;
+    case OP_ADD_REG:
+    case OP_SUB:
+    case OP_SHR:
+    case OP_SUBN:
+    case OP_SHL:
+    case OP_DRW: c->v_known[x] = c->v_known[0xF] = false; break;
+    case OP_LOAD:
+        for (s32 i = 0; i <= x; ++i)
+            c->v_known[i] = false;
+        c->i_known = false;
+        break;
+    case OP_LD_I:
+        c->i_known = true;
+        c->i       = OP_NNN(op);
+        break;
+    case OP_ADD_I:
+        c->i_known = c->i_known && c->v_known[x];
+        c->i += c->v[x];
+        break;
+    case OP_LD_FONT:
+        c->i_known = c->v_known[x];
+        c->i       = c->v[x] * 5;
+        break;
+    case OP_LD_HFONT:
+        c->i_known = c->v_known[x];
+        c->i       = BIG_FONT_ADDR + (c->v[x] & 0xF) * 10;
+        break;
+    case OP_STORE: c->i_known = false; break; // how I moves depends on the quirk profile
+    }
+}
+
+static void mark(RomAnalysis* a, u16 lo, s32 len, u8 flag)
+{
+    for (s32 i = 0; i < len && lo + i < 4096; ++i)
+        a->flags[lo + i] |= flag;
+}
+
+// Forms basic blocks from the leaders and follows constants through each of
+// them. Returns the number of newly resolved BNNN targets pushed onto 'work'.
+static s32 formBlocks(RomAnalysis* a, u8* memory, u16* work)
+{
+    s32 count      = 0;
+    a->block_count = a->indirect_count = a->write_count = 0;
+
+    for (u16 start = 0; start < 4095; ++start) {
+        if ((a->flags[start] & (BYTE_LEADER | BYTE_CODE)) != (BYTE_LEADER | BYTE_CODE)) continue;
+
+        BasicBlock* b = &a->blocks[a->block_count++];
+        memset(b, 0, sizeof(BasicBlock));
+        b->start = start;
+
+        Consts c;
+        memset(&c, 0, sizeof(Consts));
+
+        u16 addr = start;
+        for (;;) {
+            u16 op = fetch(memory, addr);
+            u32 f  = op_info[decodeOpcode(op, a->profile)].flags;
+            s32 n  = opcodeMemorySpan(op, a->profile);
+
+            if (c.i_known && (f & OPF_READ_I)) mark(a, c.i, n, BYTE_DATA);
+            if (f & OPF_WRITE_I) {
+                if (c.i_known) mark(a, c.i, n, BYTE_WRITTEN);
+                CodeWrite* w = &a->writes[a->write_count++];
+                w->pc        = addr;
+                w->known     = c.i_known;
+                w->lo        = c.i;
+                w->hi        = c.i + n - 1;
+            }
+
+            if (f & OPF_INDIRECT) {
+                IndirectJump* j = &a->indirect[a->indirect_count++];
+                j->pc           = addr;
+                j->reg          = decodeOpcode(op, a->profile) == OP_JP_VX ? OP_X(op) : 0;
+                j->base         = OP_NNN(op);
+                j->target       = OP_NNN(op) + c.v[j->reg];
+                j->resolved     = c.v_known[j->reg] && j->target <= 0xFFE; // past the end of memory is not a target
+                if (j->resolved) {
+                    b->succ[b->succ_count++] = j->target;
+                    if (!(a->flags[j->target] & BYTE_CODE)) push(a, work, &count, j->target, BYTE_JUMP_TARGET);
+                } else
+                    b->indirect = true;
+            }
+
+            step(&c, op, a->profile);
+            addr += 2;
+
+            if (f & OPF_JUMP) {
+                if (!(f & OPF_INDIRECT)) b->succ[b->succ_count++] = OP_NNN(op);
+                break;
+            }
+            if (f & OPF_RETURN) break;
+            if (f & (OPF_CALL | OPF_SKIP)) {
+                b->succ[b->succ_count++] = (f & OPF_CALL) ? OP_NNN(op) : addr + 2;
+                b->succ[b->succ_count++] = addr;
+                break;
+            }
+            if (addr >= 4095 || !(a->flags[addr] & BYTE_CODE)) break;
+            if (a->flags[addr] & BYTE_LEADER) {
+                b->succ[b->succ_count++] = addr;
+                break;
+            }
+        }
+        b->end = addr;
+    }
+
+    return count;
+}
+
+//------------------------------------------------------------------------------
+//                               Analysis
+//------------------------------------------------------------------------------
+
+void analyzeRom(RomAnalysis* a, u8* memory, u16 rom_size, QuirkProfile profile)
+{
+    memset(a, 0, sizeof(RomAnalysis));
+    a->rom_end  = 0x200 + rom_size;
+    a->profile  = profile;
+    a->blocks   = xcalloc(MAX_ENTRIES, sizeof(BasicBlock));
+    a->indirect = xcalloc(MAX_ENTRIES, sizeof(IndirectJump));
+    a->writes   = xcalloc(MAX_ENTRIES, sizeof(CodeWrite));
+
+    u16 work[MAX_ENTRIES];
+    s32 count = 0;
+    push(a, work, &count, 0x200, 0);
+
+    // Resolving a BNNN can make more code reachable, which can resolve more
+    // BNNNs, so repeat until nothing new turns up.
+    do {
+        discover(a, memory, work, count);
+        count = formBlocks(a, memory, work);
+    } while (count > 0);
+
+    // Only writes that land on code are interesting.
+    s32 kept = 0;
+    for (s32 i = 0; i < a->write_count; ++i) {
+        CodeWrite* w    = &a->writes[i];
+        bool       hits = !w->known;
+        for (s32 addr = w->lo; w->known && addr <= w->hi && addr < 4096; ++addr)
+            if (a->flags[addr] & BYTE_CODE) hits = true;
+        if (hits) a->writes[kept++] = *w;
+    }
+    a->write_count = kept;
+}
+
+void freeAnalysis(RomAnalysis* a)
+{
+    free(a->blocks);
+    free(a->indirect);
+    free(a->writes);
+}
+
+void printAnalysis(RomAnalysis* a, u8* memory)
+{
+    s32 code = 0, data = 0, unknown = 0;
+    for (s32 addr = 0x200; addr < a->rom_end; ++addr) {
+        if (a->flags[addr] & BYTE_CODE)
+            ++code;
+        else if (a->flags[addr] & BYTE_DATA)
+            ++data;
+        else
+            ++unknown;
+    }
+
+    printf("ROM 0x200-0x%03X: %d blocks, %d code bytes, %d data bytes, %d unclassified bytes\n", a->rom_end - 1,
+        a->block_count, code, data, unknown);
+
+    if (a->indirect_count) printf("\nIndirect jumps:\n");
+    for (s32 i = 0; i < a->indirect_count; ++i) {
+        IndirectJump* j = &a->indirect[i];
+        if (j->resolved)
+            printf("  0x%03X: JP V%X, 0x%03X -> 0x%03X\n", j->pc, j->reg, j->base, j->target);
+        else
+            printf("  0x%03X: JP V%X, 0x%03X -> 0x%03X..0x%03X (unresolved)\n", j->pc, j->reg, j->base, j->base,
+                j->base + 0xFF);
+    }
+
+    if (a->write_count) printf("\nSelf-modifying writes:\n");
+    for (s32 i = 0; i < a->write_count; ++i) {
+        CodeWrite* w = &a->writes[i];
+        char       text[32];
+        disassemble(fetch(memory, w->pc), a->profile, text, sizeof(text));
+        if (w->known)
+            printf("  0x%03X: %-14s writes code at 0x%03X..0x%03X\n", w->pc, text, w->lo, w->hi);
+        else
+            printf("  0x%03X: %-14s writes through unknown I\n", w->pc, text);
+    }
+
+    BasicBlock** ending = xcalloc(4097, sizeof(BasicBlock*));
+    for (s32 i = 0; i < a->block_count; ++i)
+        ending[a->blocks[i].end] = &a->blocks[i];
+
+    printf("\n");
+    for (s32 addr = 0x200; addr < a->rom_end;) {
+        u8 f = a->flags[addr];
+
+        if ((f & BYTE_CODE) && addr + 1 < 4096) {
+            if (f & BYTE_LEADER) {
+                printf("%sL_%03X:%s\n", addr == 0x200 ? "" : "\n", addr,
+                    (f & BYTE_CALL_TARGET) ? "  ; subroutine" : "");
+            }
+
+            char text[32];
+            u16  op = fetch(memory, addr);
+            disassemble(op, a->profile, text, sizeof(text));
+            bool modified = (f | a->flags[addr + 1]) & BYTE_WRITTEN;
+            printf("  0x%03X  %04X  %-16s%s\n", addr, op, text, modified ? "; modified" : "");
+
+            addr += 2;
+
+            // Print the successors after the last instruction of the block.
+            BasicBlock* b = ending[addr];
+            if (b && (b->succ_count || b->indirect)) {
+                printf("          ->");
+                for (s32 k = 0; k < b->succ_count; ++k)
+                    printf(" L_%03X", b->succ[k]);
+                if (b->indirect) printf(" ?");
+                printf("\n");
+            }
+            continue;
+        }
+
+        // Group runs of non-code bytes of the same kind, eight to a line.
+        u8  kind = f & BYTE_DATA;
+        s32 n    = 0;
+        printf("  0x%03X  %s", addr, kind ? "sprite" : "data  ");
+        while (addr < a->rom_end && n < 8 && !(a->flags[addr] & BYTE_CODE) && (a->flags[addr] & BYTE_DATA) == kind) {
+            printf(" %02X", memory[addr++]);
+            ++n;
+        }
+        printf("\n");
+    }
+
+    free(ending);
+}
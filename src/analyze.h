@@ -0,0 +1,72 @@
+#ifndef ANALYZE_H
+#define ANALYZE_H
+
+#include "opcode.h"
+#include "typedefs.h"
+
+//------------------------------------------------------------------------------
+//                               Static ROM Analysis
+//------------------------------------------------------------------------------
+
+// Per-byte classification of the address space.
+enum {
+    BYTE_CODE        = 1 << 0, // part of a reachable instruction
+    BYTE_DATA        = 1 << 1, // read through I by DXYN or FX65
+    BYTE_WRITTEN     = 1 << 2, // may be written through I by FX33 or FX55
+    BYTE_LEADER      = 1 << 3, // first instruction of a basic block
+    BYTE_JUMP_TARGET = 1 << 4,
+    BYTE_CALL_TARGET = 1 << 5,
+};
+
+typedef struct
+{
+    u16 start;
+    u16 end; // one past the last instruction
+    u16 succ[2];
+    s32 succ_count;
+    bool indirect; // ends in BNNN whose target could not be resolved
+} BasicBlock;
+
+// BNNN site, or BXNN on CHIP-48 and SUPER-CHIP. If the register is known
+// where the jump happens the target is resolved, otherwise it can be
+// anything in NNN..NNN+0xFF.
+typedef struct
+{
+    u16  pc;
+    u8   reg; // 0, or X for BXNN
+    u16  base;
+    bool resolved;
+    u16  target;
+} IndirectJump;
+
+// FX33/FX55 that may overwrite reachable code.
+typedef struct
+{
+    u16  pc;
+    bool known; // I is known at the write, so lo..hi is exact
+    u16  lo;
+    u16  hi;
+} CodeWrite;
+
+typedef struct
+{
+    u8           flags[4096];
+    u16          rom_end;
+    QuirkProfile profile; // decides which opcodes exist and how BNNN jumps
+
+    BasicBlock* blocks;
+    s32         block_count;
+
+    IndirectJump* indirect;
+    s32           indirect_count;
+
+    CodeWrite* writes;
+    s32        write_count;
+} RomAnalysis;
+
+// 'memory' is the full 4K address space with the ROM loaded at 0x200.
+void analyzeRom(RomAnalysis* a, u8* memory, u16 rom_size, QuirkProfile profile);
+void printAnalysis(RomAnalysis* a, u8* memory);
+void freeAnalysis(RomAnalysis* a);
+
+#endif
@@ -0,0 +1,231 @@
+#include "audio.h"
+#include "chip8.h"
+#include "log.h"
+#include "utility.h"
+#include <math.h> // pow
+#include <stdlib.h> // free
+#include <string.h> // strcmp
+#include <time.h> // nanosleep
+
+#define BEEP_HZ 440
+#define AMPLITUDE 8192
+
+//------------------------------------------------------------------------------
+//                               Sinks
+//------------------------------------------------------------------------------
+
+static void nullWrite(AudioSink* sink, s16* samples, u32 count)
+{
+    (void)samples;
+    sink->bytes += count * sizeof(s16);
+}
+
+static void nullClose(AudioSink* sink) { (void)sink; }
+
+static void pipeWrite(AudioSink* sink, s16* samples, u32 count)
+{
+    sink->bytes += fwrite(samples, sizeof(s16), count, sink->file) * sizeof(s16);
+}
+
+static void pipeClose(AudioSink* sink) { pclose(sink->file); }
+
+static void put32(u8* p, u32 v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+static void put16(u8* p, u16 v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+}
+
+// 44 byte header for 16 bit mono PCM. The sizes are filled in on close.
+static void wavHeader(u8* h, u32 rate, u32 bytes)
+{
+    memcpy(h, "RIFF", 4);
+    put32(h + 4, 36 + bytes);
+    memcpy(h + 8, "WAVEfmt ", 8);
+    put32(h + 16, 16);
+    put16(h + 20, 1); // PCM
+    put16(h + 22, 1); // channels
+    put32(h + 24, rate);
+    put32(h + 28, rate * sizeof(s16));
+    put16(h + 32, sizeof(s16));
+    put16(h + 34, 16);
+    memcpy(h + 36, "data", 4);
+    put32(h + 40, bytes);
+}
+
+static void wavWrite(AudioSink* sink, s16* samples, u32 count)
+{
+    // WAV is little endian, as is every host this runs on.
+    sink->bytes += fwrite(samples, sizeof(s16), count, sink->file) * sizeof(s16);
+}
+
+static void wavClose(AudioSink* sink)
+{
+    u8 header[44];
+    wavHeader(header, AUDIO_RATE, sink->bytes);
+    fseek(sink->file, 0, SEEK_SET);
+    fwrite(header, 1, sizeof(header), sink->file);
+    fclose(sink->file);
+}
+
+static bool openSink(AudioSink* sink, char* spec)
+{
+    if (strcmp(spec, "null") == 0) {
+        *sink = (AudioSink){ "null", nullWrite, nullClose, NULL, 0 };
+        return true;
+    }
+
+    if (spec[0] == '|') {
+        FILE* f = popen(spec + 1, "w");
+        if (!f) return false;
+        *sink = (AudioSink){ "pipe", pipeWrite, pipeClose, f, 0 };
+        return true;
+    }
+
+    FILE* f = fopen(spec, "wb");
+    if (!f) return false;
+    u8 header[44];
+    wavHeader(header, AUDIO_RATE, 0);
+    fwrite(header, 1, sizeof(header), f);
+    *sink = (AudioSink){ "wav", wavWrite, wavClose, f, 0 };
+    return true;
+}
+
+//------------------------------------------------------------------------------
+//                               Audio Thread
+//------------------------------------------------------------------------------
+
+static s32 drain(Audio* a)
+{
+    u32 head  = __atomic_load_n(&a->head, __ATOMIC_ACQUIRE);
+    u32 tail  = a->tail;
+    s32 count = head - tail;
+
+    // Hand over at most two runs, split where the ring wraps.
+    while (tail != head) {
+        u32 at  = tail & (AUDIO_RING_SIZE - 1);
+        u32 run = head - tail;
+        if (run > AUDIO_RING_SIZE - at) run = AUDIO_RING_SIZE - at;
+        a->sink.write(&a->sink, a->ring + at, run);
+        tail += run;
+        __atomic_store_n(&a->tail, tail, __ATOMIC_RELEASE);
+    }
+    return count;
+}
+
+static void* run(void* arg)
+{
+    Audio*          a    = arg;
+    struct timespec idle = { 0, 2000000 };
+    while (!__atomic_load_n(&a->stopping, __ATOMIC_ACQUIRE))
+        if (!drain(a)) nanosleep(&idle, NULL);
+    drain(a);
+    return NULL;
+}
+
+//------------------------------------------------------------------------------
+//                               Synthesis
+//------------------------------------------------------------------------------
+
+bool audioAttach(Chip8* c8, char* spec)
+{
+    Audio* a = xcalloc(1, sizeof(Audio));
+    if (!openSink(&a->sink, spec)) {
+        free(a);
+        return false;
+    }
+    a->rate        = AUDIO_RATE;
+    a->frame_cycle = c8->cycles;
+    c8->audio      = a;
+    pthread_create(&a->thread, NULL, run, a);
+    return true;
+}
+
+// Samples in the current frame: rate / 60, plus one whenever the carried
+// remainder adds up to a whole sample.
+static u32 frameSamples(Audio* a) { return a->rate / 60 + (a->frame_remainder + a->rate % 60 >= 60); }
+
+// Synthesizes this frame's samples up to 'upto' from the current sound state.
+static void synthesize(Audio* a, Chip8* c8, u32 upto)
+{
+    if (upto <= a->frame_done) return;
+    u32 count     = upto - a->frame_done;
+    a->frame_done = upto;
+
+    u32 head = a->head;
+    u32 room = AUDIO_RING_SIZE - (head - __atomic_load_n(&a->tail, __ATOMIC_ACQUIRE));
+    while (a->offline && count > room) {
+        struct timespec wait = { 0, 500000 };
+        nanosleep(&wait, NULL);
+        room = AUDIO_RING_SIZE - (head - __atomic_load_n(&a->tail, __ATOMIC_ACQUIRE));
+    }
+    if (count > room) {
+        a->overruns += count - room;
+        count = room;
+    }
+
+    bool on = c8->sound_timer > 0;
+    if (!on) {
+        // Silence restarts the waveform, so every beep starts the same way.
+        a->phase = 0;
+        for (u32 i = 0; i < count; ++i)
+            a->ring[(head + i) & (AUDIO_RING_SIZE - 1)] = 0;
+    } else if (c8->pattern_set) {
+        // XO-CHIP: the 128 bit pattern buffer played at 4000 * 2^((pitch - 64) / 48) bits per second.
+        f64 step = 4000.0 * pow(2.0, (c8->pitch - 64) / 48.0) / a->rate;
+        for (u32 i = 0; i < count; ++i) {
+            u32 bit = (u32)a->phase & 127;
+            s16 s   = (c8->pattern[bit >> 3] >> (7 - (bit & 7))) & 1 ? AMPLITUDE : -AMPLITUDE;
+            a->ring[(head + i) & (AUDIO_RING_SIZE - 1)] = s;
+            a->phase += step;
+            if (a->phase >= 128) a->phase -= 128;
+        }
+    } else {
+        f64 step = (f64)BEEP_HZ / a->rate;
+        for (u32 i = 0; i < count; ++i) {
+            a->ring[(head + i) & (AUDIO_RING_SIZE - 1)] = a->phase < 0.5 ? AMPLITUDE : -AMPLITUDE;
+            a->phase += step;
+            if (a->phase >= 1) a->phase -= 1;
+        }
+    }
+
+    __atomic_store_n(&a->head, head + count, __ATOMIC_RELEASE);
+}
+
+void audioSync(Audio* a, Chip8* c8)
+{
+    u64 into = c8->cycles - a->frame_cycle;
+    if (into > CYCLES_PER_FRAME) into = CYCLES_PER_FRAME;
+    synthesize(a, c8, frameSamples(a) * into / CYCLES_PER_FRAME);
+}
+
+void audioFrame(Audio* a, Chip8* c8)
+{
+    synthesize(a, c8, frameSamples(a));
+    a->frame_remainder = (a->frame_remainder + a->rate % 60) % 60;
+    a->frame_done      = 0;
+    a->frame_cycle     = c8->cycles;
+}
+
+void audioDetach(Chip8* c8)
+{
+    Audio* a = c8->audio;
+    if (!a) return;
+
+    __atomic_store_n(&a->stopping, 1, __ATOMIC_RELEASE);
+    pthread_join(a->thread, NULL);
+    a->sink.close(&a->sink);
+
+    log_info("Audio: %u bytes to the %s sink, %llu samples dropped", a->sink.bytes, LOG_STR(a->sink.name),
+        (unsigned long long)a->overruns);
+
+    c8->audio = NULL;
+    free(a);
+}
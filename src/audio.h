@@ -0,0 +1,79 @@
+#ifndef AUDIO_H
+#define AUDIO_H
+
+#include "typedefs.h"
+#include <pthread.h>
+#include <stdio.h> // FILE
+
+struct Chip8;
+
+//------------------------------------------------------------------------------
+//                               Audio
+//------------------------------------------------------------------------------
+
+// Samples are synthesized on the emulation thread, rate / 60 per emulated
+// frame, so the audio follows emulated time exactly however the frames are
+// paced. Instructions that change the sound catch the frame's samples up to
+// their cycle first, so a beep starts and changes pitch on the sample its
+// instruction maps to. They go through a single producer, single consumer ring
+// buffer to an audio thread that hands them to the sink. The emulation
+// thread never waits: when the ring is full the samples are dropped and
+// counted as overruns. Offline runs, which emulate faster than real time,
+// set 'offline' so that the emulation thread waits for room instead.
+
+#define AUDIO_RATE 44100
+#define AUDIO_RING_SIZE 16384 // samples, a power of two; about 370 ms
+
+// Where samples end up. 'write' runs on the audio thread and may block.
+typedef struct AudioSink
+{
+    char* name;
+    void (*write)(struct AudioSink* sink, s16* samples, u32 count);
+    void (*close)(struct AudioSink* sink);
+    FILE* file;
+    u32   bytes; // sample bytes written, for the WAV header
+} AudioSink;
+
+typedef struct Audio
+{
+    s16 ring[AUDIO_RING_SIZE];
+    u32 head; // next slot the emulation thread writes
+    u32 tail; // next slot the audio thread reads
+    u64 overruns; // samples dropped because the ring was full
+    bool offline; // wait for room in the ring rather than drop samples
+
+    u32 rate;
+    u32 frame_remainder; // rate % 60 carried between frames
+    u32 frame_done; // samples of the current frame already synthesized
+    u64 frame_cycle; // machine cycle count when the current frame began
+    f64 phase; // position in the waveform, in cycles or pattern bits
+
+    AudioSink sink;
+    pthread_t thread;
+    u32       stopping;
+} Audio;
+
+// Attaches audio output to the machine. 'spec' picks the sink:
+//
+//   null        discard everything
+//   |command    pipe raw signed 16 bit mono samples to a player, e.g.
+//               "|aplay -q -f S16_LE -r 44100 -c 1"
+//   path        write a WAV file
+//
+// Returns false if the sink could not be opened.
+bool audioAttach(struct Chip8* c8, char* spec);
+
+// Synthesizes the samples of the current frame up to the machine's cycle
+// count, from the sound state before it changes. Called by FX18, F002 and
+// FX3A.
+void audioSync(Audio* a, struct Chip8* c8);
+
+// Synthesizes the rest of the frame's samples from the machine's sound state.
+// Called by updateTimers() before the sound timer is decremented.
+void audioFrame(Audio* a, struct Chip8* c8);
+
+// Stops the audio thread after the queued samples have reached the sink,
+// and closes the sink.
+void audioDetach(struct Chip8* c8);
+
+#endif
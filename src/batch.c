@@ -0,0 +1,109 @@
+#include "batch.h"
+#include "chip8.h"
+#include "utility.h"
+#include <pthread.h>
+#include <stdlib.h> // free
+#include <string.h> // strrchr
+#include <unistd.h> // sysconf
+
+typedef struct
+{
+    char** roms;
+    s32    count;
+    u64    frames;
+    s32    profile;
+    char*  trace; // trace file name, or NULL
+    char*  sound; // audio sink, or NULL
+    s32    next; // index of the next ROM to pick up
+} Batch;
+
+// The file ROM 'index' writes to. With more than one ROM the index goes in
+// front of the extension, so "run.tr" becomes "run.0.tr", "run.1.tr", ...
+// Audio sinks that are not files are shared by name.
+static char* outputPath(char* path, s32 index, s32 count)
+{
+    if (count == 1 || path[0] == '|' || strcmp(path, "null") == 0) return path;
+    char* slash = strrchr(path, '/');
+    char* dot   = strrchr(path, '.');
+    if (!dot || (slash && dot < slash)) return strf("%s.%d", path, index);
+    return strf("%.*s.%d%s", (int)(dot - path), path, index, dot);
+}
+
+static void runInstance(Batch* batch, s32 index)
+{
+    char* rom    = batch->roms[index];
+    u64   frames = batch->frames;
+
+    // Each ROM reuses the memory of the one before it on this thread.
+    ArenaMark scope = temp_begin();
+    Chip8*    c8    = arena_alloc(temp_arena(), sizeof(Chip8));
+    initilize(c8);
+    setProfile(c8, batch->profile);
+    loadGame(c8, rom);
+
+    if (batch->trace) {
+        char* path = outputPath(batch->trace, index, batch->count);
+        if (!traceAttach(c8, path)) error("Could not create trace file: %s", path);
+    }
+    if (batch->sound) {
+        char* sink = outputPath(batch->sound, index, batch->count);
+        if (!audioAttach(c8, sink)) error("Could not open audio sink: %s", sink);
+        c8->audio->offline = true;
+    }
+
+    u64 start  = get_time_ns();
+    u64 parked = 0;
+    while (c8->frames < frames) {
+        // A sink gets every frame, silent or not, so nothing is skipped or cut short.
+        if (c8->audio && c8->state != CHIP8_FAULT) {
+            runFrame(c8);
+            continue;
+        }
+        if (c8->state == CHIP8_WAIT_KEY) {
+            // No input source in a batch run, so nothing will ever wake it.
+            parked = frames - c8->frames;
+            skipFrames(c8, parked);
+            break;
+        }
+        // Spinning with no timer running; nothing observable will change again.
+        if (c8->state == CHIP8_HALTED || c8->state == CHIP8_FAULT) break;
+        runFrame(c8);
+    }
+    f64 ms = (get_time_ns() - start) / 1.0e6;
+
+    char* states[] = { "running", "waiting for key", "idle", "halted", "stopped", "faulted", "drawing" };
+    info("%s: %s after %llu frames, %llu cycles (%llu skipped), %llu parked, %.3f ms", rom, states[c8->state],
+        (unsigned long long)c8->frames, (unsigned long long)c8->cycles, (unsigned long long)c8->skipped_cycles,
+        (unsigned long long)parked, ms);
+    traceDetach(c8);
+    audioDetach(c8);
+    temp_end(scope);
+}
+
+static void* worker(void* arg)
+{
+    Batch* batch = arg;
+    for (;;) {
+        s32 i = __atomic_fetch_add(&batch->next, 1, __ATOMIC_RELAXED);
+        if (i >= batch->count) break;
+        runInstance(batch, i);
+    }
+    arena_free(temp_arena());
+    return NULL;
+}
+
+void runBatch(char** roms, s32 count, u64 frames, s32 threads, s32 profile, char* trace, char* sound)
+{
+    if (threads <= 0) threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads > count) threads = count;
+    if (threads < 1) threads = 1;
+
+    Batch batch = { roms, count, frames, profile, trace, sound, 0 };
+
+    pthread_t* pool = xmalloc(sizeof(pthread_t) * threads);
+    for (s32 i = 0; i < threads; ++i)
+        pthread_create(&pool[i], NULL, worker, &batch);
+    for (s32 i = 0; i < threads; ++i)
+        pthread_join(pool[i], NULL);
+    free(pool);
+}
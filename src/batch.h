@@ -0,0 +1,18 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "typedefs.h"
+
+// Runs every ROM headless for 'frames' frames, spread over 'threads' worker
+// threads. Machines parked on FX0A have nothing that can wake them in a
+// batch run, so they are fast-forwarded instead of occupying a core, and
+// machines that halt in an idle loop end their run early. Every machine uses
+// the QuirkProfile 'profile'.
+//
+// If 'trace' is set, every ROM records an execution trace there, and if
+// 'sound' is set, every ROM's audio goes to that sink (see audioAttach())
+// for the full 'frames', without skipping. With more than one ROM each gets
+// its own file, numbered in command line order.
+void runBatch(char** roms, s32 count, u64 frames, s32 threads, s32 profile, char* trace, char* sound);
+
+#endif
@@ -0,0 +1,639 @@
+#include "chip8.h"
+#include "log.h"
+#include "opcode.h"
+#include "utility.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+static u8 chip8_fontset[80] = {
+    0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
+    0x20, 0x60, 0x20, 0x20, 0x70, // 1
+    0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
+    0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
+    0x90, 0x90, 0xF0, 0x10, 0x10, // 4
+    0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
+    0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
+    0xF0, 0x10, 0x20, 0x40, 0x40, // 7
+    0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
+    0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
+    0xF0, 0x90, 0xF0, 0x90, 0x90, // A
+    0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
+    0xF0, 0x80, 0x80, 0x80, 0xF0, // C
+    0xE0, 0x90, 0x90, 0x90, 0xE0, // D
+    0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
+    0xF0, 0x80, 0xF0, 0x80, 0x80 // F
+};
+
+// SUPER-CHIP 8x10 digits, with XO-CHIP's A-F, at BIG_FONT_ADDR.
+static u8 chip8_big_fontset[160] = {
+    0x3C, 0x7E, 0xE7, 0xC3, 0xC3, 0xC3, 0xC3, 0xE7, 0x7E, 0x3C, // 0
+    0x18, 0x38, 0x58, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x3C, // 1
+    0x3E, 0x7F, 0xC3, 0x06, 0x0C, 0x18, 0x30, 0x60, 0xFF, 0xFF, // 2
+    0x3C, 0x7E, 0xC3, 0x03, 0x0E, 0x0E, 0x03, 0xC3, 0x7E, 0x3C, // 3
+    0x06, 0x0E, 0x1E, 0x36, 0x66, 0xC6, 0xFF, 0xFF, 0x06, 0x06, // 4
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFC, 0xFE, 0x03, 0xC3, 0x7E, 0x3C, // 5
+    0x3E, 0x7C, 0xE0, 0xC0, 0xFC, 0xFE, 0xC3, 0xC3, 0x7E, 0x3C, // 6
+    0xFF, 0xFF, 0x03, 0x06, 0x0C, 0x18, 0x30, 0x60, 0x60, 0x60, // 7
+    0x3C, 0x7E, 0xC3, 0xC3, 0x7E, 0x7E, 0xC3, 0xC3, 0x7E, 0x3C, // 8
+    0x3C, 0x7E, 0xC3, 0xC3, 0x7F, 0x3F, 0x03, 0x03, 0x3E, 0x7C, // 9
+    0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, // A
+    0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, // B
+    0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C, // C
+    0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // E
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0 // F
+};
+
+
+void loadGame(Chip8* c8, char* filename)
+{
+    info("Loading game: %s", filename);
+    readRom(c8, filename);
+    info("Filesize: %d\n", (int)c8->rom_size);
+}
+
+void readRom(Chip8* c8, char* filename)
+{
+    // Open file
+    FILE* pFile = fopen(filename, "rb");
+    if (pFile == NULL) {
+        error("File error");
+    }
+
+    // Check file size
+    fseek(pFile, 0, SEEK_END);
+    long lSize = ftell(pFile);
+    rewind(pFile);
+
+    if (lSize > 4096 - 512) error("Error: ROM too big for memory");
+
+    // Read the file straight into Chip8 memory
+    size_t result = fread(c8->memory + 512, 1, lSize, pFile);
+    if ((long)result != lSize) {
+        error("Reading error");
+    }
+    c8->rom_size = lSize;
+
+    // Close file
+    fclose(pFile);
+}
+
+void initilize(Chip8* c8)
+{
+    // Initialize registers and memory once
+    info("initilizing..");
+
+    c8->pc     = 0x200; // Program counter starts at 0x200 (Start adress program)
+    c8->opcode = 0; // Reset current opcode
+    c8->I      = 0; // Reset index register
+    c8->sp     = 0; // Reset stack pointer
+
+    c8->rom_size = 0;
+    c8->debugger = NULL;
+    c8->audio    = NULL;
+    c8->tracer   = NULL;
+    setProfile(c8, PROFILE_MODERN);
+
+    // Clear display
+    displayInit(&c8->display);
+    memset(c8->rpl, 0, sizeof(c8->rpl));
+    memset(c8->pattern, 0, sizeof(c8->pattern));
+    c8->pitch       = 64;
+    c8->pattern_set = false;
+
+    // Clear stack
+    for (int i = 0; i < 16; ++i)
+        c8->stack[i] = 0;
+
+    for (int i = 0; i < 16; ++i)
+        c8->V[i] = 0;
+
+    keypad_reset(&c8->keypad);
+    c8->cycles   = 0;
+    c8->frames   = 0;
+    c8->state    = CHIP8_RUNNING;
+    c8->wait_reg = 0;
+    c8->fault    = FAULT_NONE;
+
+    c8->idle_jump      = 0xFFFF;
+    c8->skipped_cycles = 0;
+
+    // Clear memory
+    for (int i = 0; i < 4096; ++i)
+        c8->memory[i] = 0;
+
+    // Load fontset
+    for (int i = 0; i < 80; ++i)
+        c8->memory[i] = chip8_fontset[i];
+    for (int i = 0; i < 160; ++i)
+        c8->memory[BIG_FONT_ADDR + i] = chip8_big_fontset[i];
+
+    // Reset timers
+    c8->delay_timer = 0;
+    c8->sound_timer = 0;
+
+    // Clear screen once
+    c8->drawFlag = true;
+
+    seedRandom(c8, time(NULL));
+}
+
+void seedRandom(Chip8* c8, u32 seed) { c8->rng = seed ? seed : 1; }
+
+void snapshotMachine(Chip8* dst, Chip8* src)
+{
+    *dst          = *src;
+    dst->debugger = NULL;
+    dst->audio    = NULL;
+    dst->tracer   = NULL;
+}
+
+//------------------------------------------------------------------------------
+//                               Idle Loop Detection
+//------------------------------------------------------------------------------
+
+// Loops longer than this are not worth checking.
+#define IDLE_MAX_LOOP_BYTES 16
+
+// Called on every backward 1NNN. If the machine arrives at the same jump twice
+// with identical V, I and delay timer, and everything between the target and
+// the jump is pure, then every further iteration repeats exactly until the
+// next timer tick. runFrame() skips those iterations in one step, or stops the
+// machine for good if no timer is running.
+//
+// A loop that never reads DT repeats across ticks too, so its record is kept
+// and the first arrival after a tick is enough to skip again. A loop that
+// polls DT has to be seen twice more after every tick. At CYCLES_PER_FRAME
+// that leaves only part of each frame to skip; the bigger win is halting,
+// which ends a batch run.
+//
+// The record only means something if execution stayed inside the loop body
+// since it was taken. Leaving the body takes a skip past the jump, and coming
+// back takes a call, a return, or some other jump. Those clear idle_jump in
+// cycle.inl, and the cycles between the two sightings must add up to a path
+// through the body.
+static void detectIdleLoop(Chip8* c8)
+{
+    // Under a debugger every iteration has to run, for breakpoints and
+    // watchpoints inside the loop and so that stepping never gets stuck.
+    if (c8->debugger) return;
+
+    u16 target = c8->opcode & 0x0FFF;
+    if (c8->pc - target > IDLE_MAX_LOOP_BYTES) {
+        c8->idle_jump = 0xFFFF;
+        return;
+    }
+
+    bool same = c8->idle_jump == c8->pc && c8->idle_I == c8->I && memcmp(c8->idle_V, c8->V, 16) == 0;
+
+    if (!same) {
+        c8->idle_jump  = c8->pc;
+        c8->idle_dt    = c8->delay_timer;
+        c8->idle_I     = c8->I;
+        c8->idle_cycle = c8->cycles;
+        memcpy(c8->idle_V, c8->V, 16);
+        return;
+    }
+
+    // Bit k of paths[i] is set if the i-th instruction of the body can be
+    // reached after k instructions, taking or not taking each skip.
+    u32  paths[IDLE_MAX_LOOP_BYTES / 2 + 3] = { 1 };
+    s32  count                               = (c8->pc - target) / 2; // instructions before the jump
+    bool reads_dt                            = false;
+    for (s32 i = 0; i < count; ++i) {
+        u16    addr = target + 2 * i;
+        OpKind op   = decodeOpcode(c8->memory[addr] << 8 | c8->memory[addr + 1], c8->profile);
+        if (!(op_info[op].flags & OPF_PURE)) {
+            c8->idle_jump = 0xFFFF;
+            return;
+        }
+        reads_dt |= op == OP_LD_VX_DT;
+        paths[i + 1] |= paths[i] << 1;
+        if (op_info[op].flags & OPF_SKIP) paths[i + 2] |= paths[i] << 1; // skipping the jump leaves the body
+    }
+
+    if (reads_dt && c8->idle_dt != c8->delay_timer) {
+        c8->idle_dt    = c8->delay_timer;
+        c8->idle_cycle = c8->cycles;
+        return;
+    }
+
+    u64 period = c8->cycles - c8->idle_cycle;
+    if (period > 31 || !((paths[count] << 1) >> period & 1)) {
+        c8->idle_cycle = c8->cycles;
+        return;
+    }
+
+    c8->idle_period = period;
+    c8->idle_cycle  = c8->cycles;
+    c8->state       = (c8->delay_timer || c8->sound_timer) ? CHIP8_IDLE : CHIP8_HALTED;
+}
+
+//------------------------------------------------------------------------------
+//                               Interpreter
+//------------------------------------------------------------------------------
+
+// Unknown opcodes only print a warning, unless a debugger is attached to stop at them.
+static void trapUnknown(Chip8* c8)
+{
+    if (c8->debugger) c8->state = CHIP8_BREAK;
+}
+
+char* chip8_fault_names[FAULT_COUNT] = {
+    [FAULT_NONE]            = "No fault",
+    [FAULT_STACK_OVERFLOW]  = "Stack overflow",
+    [FAULT_STACK_UNDERFLOW] = "Stack underflow",
+    [FAULT_MEMORY]          = "Memory access out of bounds",
+    [FAULT_PC]              = "Program counter out of bounds",
+};
+
+// Stops the machine before the instruction at pc does any damage.
+static void fault(Chip8* c8, Chip8Fault f)
+{
+    c8->state = CHIP8_FAULT;
+    c8->fault = f;
+    log_warning("%s at 0x%03X", LOG_STR(chip8_fault_names[f]), c8->pc);
+}
+
+// Faults if 'span' bytes at I do not fit in memory.
+static bool outOfBounds(Chip8* c8, s32 span)
+{
+    if (c8->I + span <= 4096) return false;
+    fault(c8, FAULT_MEMORY);
+    return true;
+}
+
+static u8 nextRandom(Chip8* c8)
+{
+    u32 x = c8->rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    c8->rng = x;
+    return x >> 24;
+}
+
+// Quirk profiles. See cycle.inl for what each quirk means.
+
+// What this interpreter has always done.
+#define ENGINE_NAME modern
+#define QUIRK_SHIFT_VY 0
+#define QUIRK_LOAD_STORE_I 2
+#define QUIRK_JUMP_VX 0
+#define QUIRK_VF_RESET 0
+#define QUIRK_ADD_I_VF 1
+#define QUIRK_WRAP 0
+#define QUIRK_DISPLAY_WAIT 0
+#define ISA_SCHIP 0
+#define ISA_XOCHIP 0
+#include "cycle.inl"
+
+// The original COSMAC VIP interpreter.
+#define ENGINE_NAME vip
+#define QUIRK_SHIFT_VY 1
+#define QUIRK_LOAD_STORE_I 2
+#define QUIRK_JUMP_VX 0
+#define QUIRK_VF_RESET 1
+#define QUIRK_ADD_I_VF 0
+#define QUIRK_WRAP 0
+#define QUIRK_DISPLAY_WAIT 1
+#define ISA_SCHIP 0
+#define ISA_XOCHIP 0
+#include "cycle.inl"
+
+// CHIP-48 on the HP-48.
+#define ENGINE_NAME chip48
+#define QUIRK_SHIFT_VY 0
+#define QUIRK_LOAD_STORE_I 1
+#define QUIRK_JUMP_VX 1
+#define QUIRK_VF_RESET 0
+#define QUIRK_ADD_I_VF 0
+#define QUIRK_WRAP 0
+#define QUIRK_DISPLAY_WAIT 0
+#define ISA_SCHIP 0
+#define ISA_XOCHIP 0
+#include "cycle.inl"
+
+// SUPER-CHIP 1.1.
+#define ENGINE_NAME schip
+#define QUIRK_SHIFT_VY 0
+#define QUIRK_LOAD_STORE_I 0
+#define QUIRK_JUMP_VX 1
+#define QUIRK_VF_RESET 0
+#define QUIRK_ADD_I_VF 0
+#define QUIRK_WRAP 0
+#define QUIRK_DISPLAY_WAIT 0
+#define ISA_SCHIP 1
+#define ISA_XOCHIP 0
+#include "cycle.inl"
+
+// XO-CHIP as Octo runs it.
+#define ENGINE_NAME xochip
+#define QUIRK_SHIFT_VY 1
+#define QUIRK_LOAD_STORE_I 2
+#define QUIRK_JUMP_VX 0
+#define QUIRK_VF_RESET 0
+#define QUIRK_ADD_I_VF 0
+#define QUIRK_WRAP 1
+#define QUIRK_DISPLAY_WAIT 0
+#define ISA_SCHIP 1
+#define ISA_XOCHIP 1
+#include "cycle.inl"
+
+typedef struct
+{
+    char* name;
+    void (*step)(Chip8* c8);
+    int (*run)(Chip8* c8, int budget);
+} Engine;
+
+static Engine engines[PROFILE_COUNT] = {
+    [PROFILE_MODERN] = { "modern", emulateCycle_modern, runCycles_modern },
+    [PROFILE_VIP] = { "vip", emulateCycle_vip, runCycles_vip },
+    [PROFILE_CHIP48] = { "chip48", emulateCycle_chip48, runCycles_chip48 },
+    [PROFILE_SCHIP] = { "schip", emulateCycle_schip, runCycles_schip },
+    [PROFILE_XOCHIP] = { "xochip", emulateCycle_xochip, runCycles_xochip },
+};
+
+s32 findProfile(char* name)
+{
+    for (s32 i = 0; i < PROFILE_COUNT; ++i)
+        if (strcmp(engines[i].name, name) == 0) return i;
+    return -1;
+}
+
+void setProfile(Chip8* c8, QuirkProfile profile)
+{
+    c8->profile = profile;
+    c8->step    = engines[profile].step;
+    c8->run     = engines[profile].run;
+}
+
+void emulateCycle(Chip8* c8) { c8->step(c8); }
+
+void updateTimers(Chip8* c8)
+{
+    if (c8->delay_timer > 0) --c8->delay_timer;
+
+    if (c8->audio) audioFrame(c8->audio, c8);
+    if (c8->sound_timer > 0) --c8->sound_timer;
+
+    if (c8->state == CHIP8_VBLANK) c8->state = CHIP8_RUNNING;
+    ++c8->frames;
+}
+
+bool wakeOnKey(Chip8* c8)
+{
+    if (c8->state != CHIP8_WAIT_KEY) return false;
+
+    s32 key = keypad_any_down(&c8->keypad, c8->cycles);
+    if (key < 0) return false;
+
+    u8 old              = c8->V[c8->wait_reg];
+    c8->V[c8->wait_reg] = key;
+    c8->pc += 2;
+    c8->state = CHIP8_RUNNING;
+    if (c8->tracer) traceWake(c8, old);
+    return true;
+}
+
+void runFrame(Chip8* c8)
+{
+    wakeOnKey(c8);
+
+    int budget = CYCLES_PER_FRAME;
+
+    // The debugger is consulted once per frame, and only takes over the
+    // instruction loop while it has something to check.
+    if (c8->debugger) {
+        debugPoll(c8->debugger);
+        if (c8->state == CHIP8_BREAK || c8->state == CHIP8_FAULT) {
+            char* reason = c8->state == CHIP8_FAULT ? chip8_fault_names[c8->fault] : "Unknown opcode";
+            c8->state    = CHIP8_RUNNING;
+            debugStop(c8, reason);
+        }
+        if (debugActive(c8->debugger)) budget = debugRunCycles(c8, budget);
+    }
+
+    // Likewise the tracer's recording loop replaces the plain one for the rest
+    // of the frame. It runs even with no budget left, since it also writes
+    // out what the debugger and wakeOnKey() recorded.
+    if (c8->tracer) budget = traceRunCycles(c8, budget);
+
+    c8->run(c8, budget);
+
+    updateTimers(c8);
+}
+
+void skipFrames(Chip8* c8, u64 frames)
+{
+    // Only the timers move while the machine is parked, so they can be advanced in one step.
+    c8->delay_timer = c8->delay_timer > frames ? c8->delay_timer - frames : 0;
+    c8->sound_timer = c8->sound_timer > frames ? c8->sound_timer - frames : 0;
+    c8->frames += frames;
+}
+
+//------------------------------------------------------------------------------
+//                               Tests
+//------------------------------------------------------------------------------
+
+static void loadProgram(Chip8* c8, u16* program, s32 count)
+{
+    // Every test starts from a copy of one freshly initialized machine.
+    static Chip8 fresh;
+    if (!fresh.step) {
+        initilize(&fresh);
+        seedRandom(&fresh, 1);
+    }
+    snapshotMachine(c8, &fresh);
+    for (s32 i = 0; i < count; ++i) {
+        c8->memory[0x200 + 2 * i] = program[i] >> 8;
+        c8->memory[0x201 + 2 * i] = program[i] & 0xFF;
+    }
+}
+
+// Runs every instruction of 'program' once on a fresh machine with 'profile'.
+static void runProgram(Chip8* c8, QuirkProfile profile, u16* program, s32 count)
+{
+    loadProgram(c8, program, count);
+    setProfile(c8, profile);
+    for (s32 i = 0; i < count; ++i)
+        c8->step(c8);
+}
+
+// Runs 'frames' frames of 'program' once with idle loops skipped and once
+// with every cycle interpreted, and checks both end the same way. Returns the
+// cycles skipped.
+static u64 idleMatchesPlain(u16* program, s32 count, s32 frames)
+{
+    static Chip8 idle, plain;
+    loadProgram(&idle, program, count);
+    loadProgram(&plain, program, count);
+    for (s32 frame = 0; frame < frames; ++frame) {
+        runFrame(&idle);
+        for (s32 i = 0; i < CYCLES_PER_FRAME; ++i) {
+            plain.step(&plain);
+            plain.idle_jump = 0xFFFF; // never seen twice, so never skipped
+        }
+        updateTimers(&plain);
+    }
+    assert(idle.pc == plain.pc && idle.I == plain.I && memcmp(idle.V, plain.V, 16) == 0);
+    assert(idle.delay_timer == plain.delay_timer && idle.sound_timer == plain.sound_timer);
+    assert(idle.cycles == plain.cycles && plain.skipped_cycles == 0);
+    return idle.skipped_cycles;
+}
+
+typedef struct
+{
+    bool shift_vy;
+    u16  load_store_i; // I after FX55 or FX65 with X = 2 and I = 0x300
+    bool jump_vx;
+    bool vf_reset;
+    bool add_i_vf;
+    bool display_wait;
+} Quirks;
+
+static Quirks profile_quirks[PROFILE_COUNT] = {
+    [PROFILE_MODERN] = { false, 0x303, false, false, true, false },
+    [PROFILE_VIP]    = { true, 0x303, false, true, false, true },
+    [PROFILE_CHIP48] = { false, 0x302, true, false, false, false },
+    [PROFILE_SCHIP]  = { false, 0x300, true, false, false, false },
+    [PROFILE_XOCHIP] = { true, 0x303, false, false, false, false },
+};
+
+static void quirkTests(Chip8* c8, QuirkProfile profile)
+{
+    Quirks* q = &profile_quirks[profile];
+
+    u16 shr[] = { 0x6103, 0x6206, 0x8126 };
+    runProgram(c8, profile, shr, 3);
+    assert(c8->V[1] == (q->shift_vy ? 3 : 1) && c8->V[0xF] == !q->shift_vy);
+
+    u16 shl[] = { 0x6181, 0x6202, 0x812E };
+    runProgram(c8, profile, shl, 3);
+    assert(c8->V[1] == (q->shift_vy ? 4 : 2) && c8->V[0xF] == !q->shift_vy);
+
+    u16 store[] = { 0xA300, 0xF255 };
+    runProgram(c8, profile, store, 2);
+    assert(c8->I == q->load_store_i);
+
+    u16 load[] = { 0xA300, 0xF265 };
+    runProgram(c8, profile, load, 2);
+    assert(c8->I == q->load_store_i);
+
+    u16 jump[] = { 0x6004, 0x6208, 0xB210 };
+    runProgram(c8, profile, jump, 3);
+    assert(c8->pc == (q->jump_vx ? 0x218 : 0x214));
+
+    u16 logic[] = { 0x8121, 0x8122, 0x8123 };
+    for (s32 i = 0; i < 3; ++i) {
+        u16 reset[] = { 0x6F05, logic[i] };
+        runProgram(c8, profile, reset, 2);
+        assert(c8->V[0xF] == (q->vf_reset ? 0 : 5));
+    }
+
+    u16 add_i[] = { 0xAFFF, 0x6102, 0xF11E };
+    runProgram(c8, profile, add_i, 3);
+    assert(c8->I == 0x1001 && c8->V[0xF] == q->add_i_vf);
+
+    // Only the first sprite is drawn in the first frame if drawing waits for the vertical blank
+    u16 draws[] = { 0xD001, 0xD001, 0xD001, 0x1206 };
+    loadProgram(c8, draws, 4);
+    setProfile(c8, profile);
+    runFrame(c8);
+    assert(c8->pc == (q->display_wait ? 0x202 : 0x206));
+    runFrame(c8);
+    assert(c8->pc == (q->display_wait ? 0x204 : 0x206));
+}
+
+void chip8_tests(void)
+{
+    static Chip8 c8;
+
+    // A jump to itself never changes anything, so it stops the machine
+    u16 spin[] = { 0x1200 };
+    loadProgram(&c8, spin, 1);
+    runFrame(&c8);
+    assert(c8.state == CHIP8_HALTED);
+
+    // Skipped iterations change nothing but the cycle count. A loop that
+    // ignores DT keeps skipping after each tick from its first arrival, one
+    // that polls DT from its second.
+    u16 wait[] = { 0x6040, 0xF015, 0x6107, 0x1204 };
+    assert(idleMatchesPlain(wait, 4, 60) == 8 * 59 + 4);
+    u16 poll[] = { 0x6005, 0xF015, 0xF107, 0x3100, 0x1204, 0x7201, 0x1202 };
+    assert(idleMatchesPlain(poll, 7, 200) > 0);
+
+    // A short loop whose skip leaves the body for a longer loop that draws is
+    // not idle, even though V, I and DT repeat at the short loop's jump
+    u16 redraw[] = { 0x6000, 0x7001, 0x3002, 0x1202, 0xA220, 0xD015, 0x6000, 0x6300, 0x6300, 0x6300, 0x1202 };
+    loadProgram(&c8, redraw, 11);
+    for (s32 frame = 0; frame < 300; ++frame) runFrame(&c8);
+    assert(c8.state == CHIP8_RUNNING);
+    assert(c8.cycles == 300 * CYCLES_PER_FRAME);
+
+    // Stepping into a jump to itself stops at it every time
+    static Debugger debugger;
+    static char     steps[] = "s\ns\ns\ns\ns\ns\ns\ns\ns\ns\ns\ns\ns\ns\ns\ns\ns\ns\ns\ns\ns\ns\n";
+    u16             self[]  = { 0x6005, 0x1202 };
+    loadProgram(&c8, self, 2);
+    debugger          = (Debugger){ .stepping = true, .socket = -1 };
+    debugger.in       = fmemopen(steps, sizeof(steps) - 1, "r");
+    debugger.out      = fopen("/dev/null", "w");
+    c8.debugger       = &debugger;
+    runFrame(&c8);
+    runFrame(&c8);
+    assert(c8.state == CHIP8_RUNNING && c8.pc == 0x202);
+    assert(c8.cycles == 2 * CYCLES_PER_FRAME);
+    fclose(debugger.in);
+    fclose(debugger.out);
+    c8.debugger = NULL;
+
+    // FX0A parks the machine until a key is down, then stores it and moves on
+    u16 wait_key[] = { 0xF30A };
+    runProgram(&c8, PROFILE_MODERN, wait_key, 1);
+    assert(c8.state == CHIP8_WAIT_KEY && c8.wait_reg == 3);
+    runFrame(&c8);
+    assert(c8.state == CHIP8_WAIT_KEY && c8.pc == 0x200 && c8.cycles == 1);
+    assert(!wakeOnKey(&c8));
+    keypad_press(&c8.keypad, 0x7, c8.cycles);
+    assert(wakeOnKey(&c8));
+    assert(c8.state == CHIP8_RUNNING && c8.pc == 0x202 && c8.V[3] == 0x7 && c8.keypad.latency.count == 1);
+
+    // Faults stop the machine and say why
+    u16 recurse[] = { 0x2200 };
+    loadProgram(&c8, recurse, 1);
+    for (s32 i = 0; i < 17; ++i) c8.step(&c8);
+    assert(c8.state == CHIP8_FAULT && c8.fault == FAULT_STACK_OVERFLOW && c8.sp == 16);
+
+    u16 ret[] = { 0x00EE };
+    runProgram(&c8, PROFILE_MODERN, ret, 1);
+    assert(c8.state == CHIP8_FAULT && c8.fault == FAULT_STACK_UNDERFLOW);
+
+    u16 store[] = { 0xAFFF, 0xF155 };
+    runProgram(&c8, PROFILE_MODERN, store, 2);
+    assert(c8.state == CHIP8_FAULT && c8.fault == FAULT_MEMORY);
+
+    u16 sprite[] = { 0xAFFE, 0xD015 };
+    runProgram(&c8, PROFILE_MODERN, sprite, 2);
+    assert(c8.state == CHIP8_FAULT && c8.fault == FAULT_MEMORY);
+
+    // 0000 at 0xFFE is a CLS outside SCHIP, after which PC is past the end
+    u16 edge[] = { 0x1FFE, 0x0000, 0x0000 };
+    runProgram(&c8, PROFILE_MODERN, edge, 3);
+    assert(c8.state == CHIP8_FAULT && c8.fault == FAULT_PC && c8.pc == 0x1000);
+
+    // The decoder agrees with what each profile's interpreter executes
+    assert(decodeOpcode(0x5121, PROFILE_MODERN) == OP_SE_REG && decodeOpcode(0x9121, PROFILE_VIP) == OP_SNE_REG);
+    assert(decodeOpcode(0x0120, PROFILE_MODERN) == OP_CLS && decodeOpcode(0x0120, PROFILE_SCHIP) == OP_UNKNOWN);
+    assert(decodeOpcode(0x00C1, PROFILE_CHIP48) == OP_UNKNOWN && decodeOpcode(0x00C1, PROFILE_SCHIP) == OP_SCD);
+    assert(decodeOpcode(0x00D1, PROFILE_SCHIP) == OP_UNKNOWN && decodeOpcode(0x00D1, PROFILE_XOCHIP) == OP_SCU);
+    assert(decodeOpcode(0xB210, PROFILE_CHIP48) == OP_JP_VX && decodeOpcode(0xB210, PROFILE_XOCHIP) == OP_JP_V0);
+    assert(decodeOpcode(0xF030, PROFILE_VIP) == OP_UNKNOWN && decodeOpcode(0xF030, PROFILE_SCHIP) == OP_LD_HFONT);
+    assert(opcodeMemorySpan(0xD010, PROFILE_MODERN) == 0 && opcodeMemorySpan(0xD010, PROFILE_SCHIP) == 32);
+
+    for (s32 profile = 0; profile < PROFILE_COUNT; ++profile)
+        quirkTests(&c8, profile);
+}
@@ -0,0 +1,121 @@
+#ifndef CHIP8_H
+#define CHIP8_H
+
+#include "audio.h"
+#include "debug.h"
+#include "display.h"
+#include "input.h"
+#include "opcode.h"
+#include "trace.h"
+#include "typedefs.h"
+
+// The SUPER-CHIP 8x10 font follows the 4x5 one.
+#define BIG_FONT_ADDR 0x50
+
+// The interpreter runs at 600 Hz and the timers at 60 Hz, so the machine
+// is advanced one 60 Hz frame at a time.
+#define CYCLES_PER_FRAME 10
+
+typedef enum {
+    CHIP8_RUNNING,
+    CHIP8_WAIT_KEY, // parked on FX0A until a key goes down
+    CHIP8_IDLE, // spinning in a side-effect free loop until the next timer tick
+    CHIP8_HALTED, // spinning in a side-effect free loop with no timer running, or exited (00FD), forever
+    CHIP8_BREAK, // hit an unknown opcode with a debugger attached
+    CHIP8_FAULT, // stopped before an instruction that would have broken the machine, see Chip8Fault
+    CHIP8_VBLANK, // drew a sprite and waits for the end of the frame (COSMAC VIP)
+} Chip8State;
+
+typedef enum {
+    FAULT_NONE,
+    FAULT_STACK_OVERFLOW, // 2NNN with all 16 stack entries in use
+    FAULT_STACK_UNDERFLOW, // 00EE with an empty stack
+    FAULT_MEMORY, // DXYN, FX33, FX55 or FX65 reaching past 0xFFF
+    FAULT_PC, // the program counter ran off the end of memory
+    FAULT_COUNT,
+} Chip8Fault;
+
+extern char* chip8_fault_names[FAULT_COUNT];
+
+typedef struct Chip8
+{
+    u16 opcode;
+    u8  memory[4096];
+    u8  V[16];
+    u16 I;
+    u16 pc;
+    u8  delay_timer;
+    u8  sound_timer;
+    u16 stack[16];
+    u16 sp;
+
+    Display display;
+    u8      drawFlag;
+
+    u8 rpl[16]; // SUPER-CHIP user flags, FX75/FX85
+
+    // XO-CHIP audio, F002 and FX3A. Without a pattern the beeper is a square wave.
+    u8   pattern[16];
+    u8   pitch;
+    bool pattern_set;
+
+    u16 rom_size; // bytes loaded at 0x200
+
+    u64        cycles;
+    u64        frames;
+    Chip8State state;
+    u8         wait_reg; // VX that receives the key once FX0A completes
+    Chip8Fault fault;
+    u32        rng; // xorshift state for CXNN, so a machine can be replayed exactly
+
+    // Idle loop detection, see detectIdleLoop()
+    u16 idle_jump; // address of the last backward 1NNN
+    u8  idle_V[16];
+    u16 idle_I;
+    u8  idle_dt;
+    u64 idle_cycle;
+    u16 idle_period; // cycles per iteration of the detected loop
+    u64 skipped_cycles;
+
+    Keypad keypad;
+
+    struct Debugger* debugger; // NULL unless attached
+    struct Audio*    audio; // NULL unless attached
+    struct Tracer*   tracer; // NULL unless recording
+
+    // Interpreter specialized for the quirk profile, see setProfile()
+    QuirkProfile profile;
+    void (*step)(struct Chip8* c8);
+    int (*run)(struct Chip8* c8, int budget);
+} Chip8;
+
+void initilize(Chip8* c8);
+
+// Picks the interpreter for 'profile'. initilize() selects PROFILE_MODERN.
+void setProfile(Chip8* c8, QuirkProfile profile);
+s32  findProfile(char* name); // -1 if there is no profile by that name
+void loadGame(Chip8* c8, char* filename);
+void readRom(Chip8* c8, char* filename); // loadGame() without the messages
+
+// Makes CXNN produce the same numbers on every run. initilize() seeds from the clock.
+void seedRandom(Chip8* c8, u32 seed);
+
+// Copies the whole machine, which is how the fuzzer forks test cases. The
+// copy has no debugger, audio or tracer attached.
+void snapshotMachine(Chip8* dst, Chip8* src);
+
+void emulateCycle(Chip8* c8);
+void updateTimers(Chip8* c8);
+
+// Finishes a pending FX0A if a key is held. Returns true if the machine woke up.
+bool wakeOnKey(Chip8* c8);
+
+// Runs one frame worth of cycles, stopping early if the machine parks, then ticks the timers.
+void runFrame(Chip8* c8);
+
+// Advances a parked machine by 'frames' frames without executing anything.
+void skipFrames(Chip8* c8, u64 frames);
+
+void chip8_tests(void);
+
+#endif
@@ -0,0 +1,498 @@
+// Interpreter template, included by chip8.c once per quirk profile.
+//
+// Before including, define ENGINE_NAME and one value for each QUIRK_*:
+//
+//   QUIRK_SHIFT_VY      8XY6/8XYE shift VY into VX instead of shifting VX in place
+//   QUIRK_LOAD_STORE_I  FX55/FX65 leave I unchanged (0), add X (1) or add X + 1 (2)
+//   QUIRK_JUMP_VX       BNNN is BXNN and jumps to XNN + VX instead of NNN + V0
+//   QUIRK_VF_RESET      8XY1/8XY2/8XY3 clear VF
+//   QUIRK_ADD_I_VF      FX1E sets VF when I overflows 0xFFF
+//   QUIRK_WRAP          sprites wrap around the screen edges instead of being clipped
+//   QUIRK_DISPLAY_WAIT  DXYN ends the frame, as the VIP waits for the vertical blank to draw
+//
+// and whether the instruction set extensions are available:
+//
+//   ISA_SCHIP           SUPER-CHIP high resolution, scrolling, big font and RPL flags
+//   ISA_XOCHIP          XO-CHIP bitplanes, scrolling up and the audio pattern
+//
+// Every quirk is resolved by the preprocessor, so each profile gets its own
+// branch-free copy of the interpreter. Everything is undefined again at the
+// end so the next profile can be included.
+
+#define ENGINE_CONCAT(a, b) a##_##b
+#define ENGINE_EXPAND(a, b) ENGINE_CONCAT(a, b)
+#define ENGINE(fn) ENGINE_EXPAND(fn, ENGINE_NAME)
+
+// Plain CHIP-8 only looks at the low nibble of 00E0 and 00EE. The extensions
+// add more 00NN opcodes, so they need the whole byte.
+#if ISA_SCHIP
+#define OP0_MASK 0x00FF
+#else
+#define OP0_MASK 0x000F
+#endif
+
+static inline void ENGINE(emulateCycle)(Chip8* c8)
+{
+    if (c8->pc > 0xFFE) {
+        fault(c8, FAULT_PC);
+        return;
+    }
+    ++c8->cycles;
+
+    // Fetch opcode
+    c8->opcode = c8->memory[c8->pc] << 8 | c8->memory[c8->pc + 1];
+
+    // Decode opcode
+    switch (c8->opcode & 0xF000) {
+
+    case 0x0000:
+        switch (c8->opcode & OP0_MASK) {
+        case 0x00E0 & OP0_MASK: // 0x00E0: Clears the screen
+            displayClear(&c8->display);
+            c8->drawFlag = true;
+            c8->pc += 2;
+            break;
+
+        case 0x00EE & OP0_MASK: // 0x00EE: Returns from subroutine
+            if (c8->sp == 0) {
+                fault(c8, FAULT_STACK_UNDERFLOW);
+                break;
+            }
+            c8->idle_jump = 0xFFFF; // left whatever loop was being watched
+            --c8->sp; // 16 levels of stack, decrease stack pointer to prevent overwrite
+            c8->pc = c8->stack[c8->sp]; // Put the stored return address from the stack back into the program counter
+            c8->pc += 2; // Don't forget to increase the program counter!
+            break;
+
+#if ISA_SCHIP
+        case 0x00FB: // 0x00FB: Scrolls the display right by 4 pixels
+            displayScroll(&c8->display, 4, 0);
+            c8->drawFlag = true;
+            c8->pc += 2;
+            break;
+
+        case 0x00FC: // 0x00FC: Scrolls the display left by 4 pixels
+            displayScroll(&c8->display, -4, 0);
+            c8->drawFlag = true;
+            c8->pc += 2;
+            break;
+
+        case 0x00FD: // 0x00FD: Exits the interpreter
+            c8->state = CHIP8_HALTED;
+            break;
+
+        case 0x00FE: // 0x00FE: Switches to low resolution
+        case 0x00FF: // 0x00FF: Switches to high resolution
+            displaySetHires(&c8->display, c8->opcode == 0x00FF);
+            c8->drawFlag = true;
+            c8->pc += 2;
+            break;
+#endif
+
+        default:
+#if ISA_SCHIP
+            if ((c8->opcode & 0xFFF0) == 0x00C0) { // 0x00CN: Scrolls the display down by N rows
+                displayScroll(&c8->display, 0, c8->opcode & 0x000F);
+                c8->drawFlag = true;
+                c8->pc += 2;
+                break;
+            }
+#endif
+#if ISA_XOCHIP
+            if ((c8->opcode & 0xFFF0) == 0x00D0) { // 0x00DN: Scrolls the display up by N rows
+                displayScroll(&c8->display, 0, -(c8->opcode & 0x000F));
+                c8->drawFlag = true;
+                c8->pc += 2;
+                break;
+            }
+#endif
+            log_warning("Unknown opcode [0x0000]: 0x%X at 0x%03X", c8->opcode, c8->pc);
+            trapUnknown(c8);
+        }
+        break;
+
+    case 0x1000: // 0x1NNN: Jumps to address NNN
+        if ((c8->opcode & 0x0FFF) <= c8->pc)
+            detectIdleLoop(c8);
+        else
+            c8->idle_jump = 0xFFFF; // left whatever loop was being watched
+        c8->pc = c8->opcode & 0x0FFF;
+        break;
+
+    case 0x2000: // 0x2NNN: Calls subroutine at NNN.
+        if (c8->sp == 16) {
+            fault(c8, FAULT_STACK_OVERFLOW);
+            break;
+        }
+        c8->idle_jump     = 0xFFFF; // left whatever loop was being watched
+        c8->stack[c8->sp] = c8->pc; // Store current address in stack
+        ++c8->sp; // Increment stack pointer
+        c8->pc = c8->opcode & 0x0FFF; // Set the program counter to the address at NNN
+        break;
+
+    case 0x3000: // 0x3XNN: Skips the next instruction if VX equals NN
+        if (c8->V[(c8->opcode & 0x0F00) >> 8] == (c8->opcode & 0x00FF))
+            c8->pc += 4;
+        else
+            c8->pc += 2;
+        break;
+
+    case 0x4000: // 0x4XNN: Skips the next instruction if VX doesn't equal NN
+        if (c8->V[(c8->opcode & 0x0F00) >> 8] != (c8->opcode & 0x00FF))
+            c8->pc += 4;
+        else
+            c8->pc += 2;
+        break;
+
+    case 0x5000: // 0x5XY0: Skips the next instruction if VX equals VY.
+        if (c8->V[(c8->opcode & 0x0F00) >> 8] == c8->V[(c8->opcode & 0x00F0) >> 4])
+            c8->pc += 4;
+        else
+            c8->pc += 2;
+        break;
+
+    case 0x6000: // 0x6XNN: Sets VX to NN.
+        c8->V[(c8->opcode & 0x0F00) >> 8] = c8->opcode & 0x00FF;
+        c8->pc += 2;
+        break;
+
+    case 0x7000: // 0x7XNN: Adds NN to VX.
+        c8->V[(c8->opcode & 0x0F00) >> 8] += c8->opcode & 0x00FF;
+        c8->pc += 2;
+        break;
+
+    case 0x8000:
+        switch (c8->opcode & 0x000F) {
+        case 0x0000: // 0x8XY0: Sets VX to the value of VY
+            c8->V[(c8->opcode & 0x0F00) >> 8] = c8->V[(c8->opcode & 0x00F0) >> 4];
+            c8->pc += 2;
+            break;
+
+        case 0x0001: // 0x8XY1: Sets VX to "VX OR VY"
+            c8->V[(c8->opcode & 0x0F00) >> 8] |= c8->V[(c8->opcode & 0x00F0) >> 4];
+#if QUIRK_VF_RESET
+            c8->V[0xF] = 0;
+#endif
+            c8->pc += 2;
+            break;
+
+        case 0x0002: // 0x8XY2: Sets VX to "VX AND VY"
+            c8->V[(c8->opcode & 0x0F00) >> 8] &= c8->V[(c8->opcode & 0x00F0) >> 4];
+#if QUIRK_VF_RESET
+            c8->V[0xF] = 0;
+#endif
+            c8->pc += 2;
+            break;
+
+        case 0x0003: // 0x8XY3: Sets VX to "VX XOR VY"
+            c8->V[(c8->opcode & 0x0F00) >> 8] ^= c8->V[(c8->opcode & 0x00F0) >> 4];
+#if QUIRK_VF_RESET
+            c8->V[0xF] = 0;
+#endif
+            c8->pc += 2;
+            break;
+
+        case 0x0004: // 0x8XY4: Adds VY to VX. VF is set to 1 when there's a carry, and to 0 when there isn't
+            if (c8->V[(c8->opcode & 0x00F0) >> 4] > (0xFF - c8->V[(c8->opcode & 0x0F00) >> 8]))
+                c8->V[0xF] = 1; // carry
+            else
+                c8->V[0xF] = 0;
+            c8->V[(c8->opcode & 0x0F00) >> 8] += c8->V[(c8->opcode & 0x00F0) >> 4];
+            c8->pc += 2;
+            break;
+
+        case 0x0005: // 0x8XY5: VY is subtracted from VX. VF is set to 0 when there's a borrow, and 1 when there isn't
+            if (c8->V[(c8->opcode & 0x00F0) >> 4] > c8->V[(c8->opcode & 0x0F00) >> 8])
+                c8->V[0xF] = 0; // there is a borrow
+            else
+                c8->V[0xF] = 1;
+            c8->V[(c8->opcode & 0x0F00) >> 8] -= c8->V[(c8->opcode & 0x00F0) >> 4];
+            c8->pc += 2;
+            break;
+
+        case 0x0006: // 0x8XY6: Shifts VX right by one. VF is set to the value of the least significant bit of VX before
+                     // the shift
+#if QUIRK_SHIFT_VY
+            c8->V[(c8->opcode & 0x0F00) >> 8] = c8->V[(c8->opcode & 0x00F0) >> 4];
+#endif
+            c8->V[0xF] = c8->V[(c8->opcode & 0x0F00) >> 8] & 0x1;
+            c8->V[(c8->opcode & 0x0F00) >> 8] >>= 1;
+            c8->pc += 2;
+            break;
+
+        case 0x0007: // 0x8XY7: Sets VX to VY minus VX. VF is set to 0 when there's a borrow, and 1 when there isn't
+            if (c8->V[(c8->opcode & 0x0F00) >> 8] > c8->V[(c8->opcode & 0x00F0) >> 4]) // VY-VX
+                c8->V[0xF] = 0; // there is a borrow
+            else
+                c8->V[0xF] = 1;
+            c8->V[(c8->opcode & 0x0F00) >> 8] = c8->V[(c8->opcode & 0x00F0) >> 4] - c8->V[(c8->opcode & 0x0F00) >> 8];
+            c8->pc += 2;
+            break;
+
+        case 0x000E: // 0x8XYE: Shifts VX left by one. VF is set to the value of the most significant bit of VX before
+                     // the shift
+#if QUIRK_SHIFT_VY
+            c8->V[(c8->opcode & 0x0F00) >> 8] = c8->V[(c8->opcode & 0x00F0) >> 4];
+#endif
+            c8->V[0xF] = c8->V[(c8->opcode & 0x0F00) >> 8] >> 7;
+            c8->V[(c8->opcode & 0x0F00) >> 8] <<= 1;
+            c8->pc += 2;
+            break;
+
+        default:
+            log_warning("Unknown opcode [0x8000]: 0x%X at 0x%03X", c8->opcode, c8->pc);
+            trapUnknown(c8);
+        }
+        break;
+
+    case 0x9000: // 0x9XY0: Skips the next instruction if VX doesn't equal VY
+        if (c8->V[(c8->opcode & 0x0F00) >> 8] != c8->V[(c8->opcode & 0x00F0) >> 4])
+            c8->pc += 4;
+        else
+            c8->pc += 2;
+        break;
+
+    case 0xA000: // ANNN: Sets I to the address NNN
+        c8->I = c8->opcode & 0x0FFF;
+        c8->pc += 2;
+        break;
+
+    case 0xB000: // BNNN: Jumps to the address NNN plus V0 (BXNN: XNN plus VX on CHIP-48 and SUPER-CHIP)
+        c8->idle_jump = 0xFFFF; // left whatever loop was being watched
+#if QUIRK_JUMP_VX
+        c8->pc = (c8->opcode & 0x0FFF) + c8->V[(c8->opcode & 0x0F00) >> 8];
+#else
+        c8->pc = (c8->opcode & 0x0FFF) + c8->V[0];
+#endif
+        break;
+
+    case 0xC000: // CXNN: Sets VX to a random number and NN
+        c8->V[(c8->opcode & 0x0F00) >> 8] = (nextRandom(c8) % 0xFF) & (c8->opcode & 0x00FF);
+        c8->pc += 2;
+        break;
+
+    case 0xD000: // DXYN: Draws a sprite at coordinate (VX, VY) that has a width of 8 pixels and a height of N pixels.
+                 // Each row of 8 pixels is read as bit-coded starting from memory location I;
+                 // I value doesn't change after the execution of this instruction.
+                 // VF is set to 1 if any screen pixels are flipped from set to unset when the sprite is drawn,
+                 // and to 0 if that doesn't happen
+    {
+        s32 rows = c8->opcode & 0x000F;
+        s32 wide = 8;
+#if ISA_SCHIP
+        // DXY0: a 16x16 sprite, two bytes per row
+        if (rows == 0) rows = wide = 16;
+#endif
+#if ISA_XOCHIP
+        if (outOfBounds(c8, rows * wide / 8 * __builtin_popcount(c8->display.planes))) break;
+#else
+        if (outOfBounds(c8, rows * wide / 8)) break;
+#endif
+        c8->V[0xF] = displayDraw(&c8->display, c8->memory, c8->I, c8->V[(c8->opcode & 0x0F00) >> 8],
+            c8->V[(c8->opcode & 0x00F0) >> 4], rows, wide, QUIRK_WRAP);
+
+        c8->drawFlag = true;
+        c8->pc += 2;
+#if QUIRK_DISPLAY_WAIT
+        c8->state = CHIP8_VBLANK; // updateTimers() lets it run again
+#endif
+    } break;
+
+    case 0xE000:
+        switch (c8->opcode & 0x00FF) {
+        case 0x009E: // EX9E: Skips the next instruction if the key stored in VX is pressed
+            if (keypad_is_down(&c8->keypad, c8->V[(c8->opcode & 0x0F00) >> 8], c8->cycles))
+                c8->pc += 4;
+            else
+                c8->pc += 2;
+            break;
+
+        case 0x00A1: // EXA1: Skips the next instruction if the key stored in VX isn't pressed
+            if (!keypad_is_down(&c8->keypad, c8->V[(c8->opcode & 0x0F00) >> 8], c8->cycles))
+                c8->pc += 4;
+            else
+                c8->pc += 2;
+            break;
+
+        default:
+            log_warning("Unknown opcode [0xE000]: 0x%X at 0x%03X", c8->opcode, c8->pc);
+            trapUnknown(c8);
+        }
+        break;
+
+    case 0xF000:
+        switch (c8->opcode & 0x00FF) {
+#if ISA_XOCHIP
+        case 0x0001: // FN01: Selects the bitplanes N that drawing, clearing and scrolling affect
+            c8->display.planes = (c8->opcode & 0x0F00) >> 8;
+            c8->pc += 2;
+            break;
+
+        case 0x0002: // F002: Loads the 16 byte audio pattern from I
+            if (c8->audio) audioSync(c8->audio, c8);
+            for (int i = 0; i < 16; ++i)
+                c8->pattern[i] = c8->memory[(c8->I + i) & 0xFFF];
+            c8->pattern_set = true;
+            c8->pc += 2;
+            break;
+#endif
+
+        case 0x0007: // FX07: Sets VX to the value of the delay timer
+            c8->V[(c8->opcode & 0x0F00) >> 8] = c8->delay_timer;
+            c8->pc += 2;
+            break;
+
+        case 0x000A: // FX0A: A key press is awaited, and then stored in VX
+        {
+            s32 key = keypad_any_down(&c8->keypad, c8->cycles);
+
+            // If no key is held, park the machine instead of re-executing this opcode every cycle.
+            // wakeOnKey() finishes the instruction once a key goes down.
+            if (key < 0) {
+                c8->state    = CHIP8_WAIT_KEY;
+                c8->wait_reg = (c8->opcode & 0x0F00) >> 8;
+                return;
+            }
+
+            c8->V[(c8->opcode & 0x0F00) >> 8] = key;
+            c8->pc += 2;
+        } break;
+
+        case 0x0015: // FX15: Sets the delay timer to VX
+            c8->delay_timer = c8->V[(c8->opcode & 0x0F00) >> 8];
+            c8->pc += 2;
+            break;
+
+        case 0x0018: // FX18: Sets the sound timer to VX
+            if (c8->audio) audioSync(c8->audio, c8);
+            c8->sound_timer = c8->V[(c8->opcode & 0x0F00) >> 8];
+            c8->pc += 2;
+            break;
+
+        case 0x001E: // FX1E: Adds VX to I
+#if QUIRK_ADD_I_VF
+            if (c8->I + c8->V[(c8->opcode & 0x0F00) >> 8]
+                > 0xFFF) // VF is set to 1 when range overflow (I+VX>0xFFF), and 0 when there isn't.
+                c8->V[0xF] = 1;
+            else
+                c8->V[0xF] = 0;
+#endif
+            c8->I += c8->V[(c8->opcode & 0x0F00) >> 8];
+            c8->pc += 2;
+            break;
+
+        case 0x0029: // FX29: Sets I to the location of the sprite for the character in VX. Characters 0-F (in
+                     // hexadecimal) are represented by a 4x5 font
+            c8->I = c8->V[(c8->opcode & 0x0F00) >> 8] * 0x5;
+            c8->pc += 2;
+            break;
+
+#if ISA_XOCHIP
+        case 0x003A: // FX3A: Sets the audio pattern playback rate to 4000 * 2^((VX - 64) / 48) bits per second
+            if (c8->audio) audioSync(c8->audio, c8);
+            c8->pitch = c8->V[(c8->opcode & 0x0F00) >> 8];
+            c8->pc += 2;
+            break;
+#endif
+
+#if ISA_SCHIP
+        case 0x0030: // FX30: Sets I to the location of the 8x10 sprite for the digit in VX
+            c8->I = BIG_FONT_ADDR + (c8->V[(c8->opcode & 0x0F00) >> 8] & 0xF) * 10;
+            c8->pc += 2;
+            break;
+#endif
+
+        case 0x0033: // FX33: Stores the Binary-coded decimal representation of VX at the addresses I, I plus 1, and I
+                     // plus 2
+            if (outOfBounds(c8, 3)) break;
+            c8->memory[c8->I]     = c8->V[(c8->opcode & 0x0F00) >> 8] / 100;
+            c8->memory[c8->I + 1] = (c8->V[(c8->opcode & 0x0F00) >> 8] / 10) % 10;
+            c8->memory[c8->I + 2] = (c8->V[(c8->opcode & 0x0F00) >> 8] % 100) % 10;
+            c8->pc += 2;
+            break;
+
+        case 0x0055: // FX55: Stores V0 to VX in memory starting at address I
+            if (outOfBounds(c8, ((c8->opcode & 0x0F00) >> 8) + 1)) break;
+            for (int i = 0; i <= ((c8->opcode & 0x0F00) >> 8); ++i)
+                c8->memory[c8->I + i] = c8->V[i];
+
+            // On the original interpreter, when the operation is done, I = I + X + 1.
+            // CHIP-48 leaves I = I + X, SUPER-CHIP leaves it alone.
+#if QUIRK_LOAD_STORE_I
+            c8->I += ((c8->opcode & 0x0F00) >> 8) + QUIRK_LOAD_STORE_I - 1;
+#endif
+            c8->pc += 2;
+            break;
+
+        case 0x0065: // FX65: Fills V0 to VX with values from memory starting at address I
+            if (outOfBounds(c8, ((c8->opcode & 0x0F00) >> 8) + 1)) break;
+            for (int i = 0; i <= ((c8->opcode & 0x0F00) >> 8); ++i)
+                c8->V[i] = c8->memory[c8->I + i];
+
+            // On the original interpreter, when the operation is done, I = I + X + 1.
+            // CHIP-48 leaves I = I + X, SUPER-CHIP leaves it alone.
+#if QUIRK_LOAD_STORE_I
+            c8->I += ((c8->opcode & 0x0F00) >> 8) + QUIRK_LOAD_STORE_I - 1;
+#endif
+            c8->pc += 2;
+            break;
+
+#if ISA_SCHIP
+        case 0x0075: // FX75: Stores V0 to VX in the RPL user flags
+            memcpy(c8->rpl, c8->V, ((c8->opcode & 0x0F00) >> 8) + 1);
+            c8->pc += 2;
+            break;
+
+        case 0x0085: // FX85: Fills V0 to VX from the RPL user flags
+            memcpy(c8->V, c8->rpl, ((c8->opcode & 0x0F00) >> 8) + 1);
+            c8->pc += 2;
+            break;
+#endif
+
+        default:
+            log_warning("Unknown opcode [0xF000]: 0x%X at 0x%03X", c8->opcode, c8->pc);
+            trapUnknown(c8);
+        }
+        break;
+
+    default:
+        log_warning("Unknown opcode: 0x%X at 0x%03X", c8->opcode, c8->pc);
+        trapUnknown(c8);
+    }
+}
+
+static int ENGINE(runCycles)(Chip8* c8, int budget)
+{
+    while (budget > 0) {
+        if (c8->state == CHIP8_RUNNING) {
+            ENGINE(emulateCycle)(c8);
+            --budget;
+        } else if (c8->state == CHIP8_IDLE) {
+            // Whole iterations leave the machine exactly as it is now, so only
+            // the leftover partial iteration needs to be interpreted.
+            int skip = budget - budget % c8->idle_period;
+            c8->cycles += skip;
+            c8->skipped_cycles += skip;
+            c8->idle_cycle = c8->cycles;
+            budget -= skip;
+            c8->state = CHIP8_RUNNING;
+        } else
+            break;
+    }
+    return budget;
+}
+
+#undef ENGINE
+#undef ENGINE_EXPAND
+#undef ENGINE_CONCAT
+#undef ENGINE_NAME
+#undef OP0_MASK
+#undef QUIRK_SHIFT_VY
+#undef QUIRK_LOAD_STORE_I
+#undef QUIRK_JUMP_VX
+#undef QUIRK_VF_RESET
+#undef QUIRK_ADD_I_VF
+#undef QUIRK_WRAP
+#undef QUIRK_DISPLAY_WAIT
+#undef ISA_SCHIP
+#undef ISA_XOCHIP
@@ -0,0 +1,380 @@
+#include "debug.h"
+#include "chip8.h"
+#include "opcode.h"
+#include "utility.h"
+#include <poll.h> // poll
+#include <stdlib.h> // strtol, exit
+#include <string.h> // strcmp, strncpy
+#include <sys/socket.h> // socket, bind, listen, accept
+#include <sys/un.h> // sockaddr_un
+#include <unistd.h> // dup, unlink
+
+static Debugger* interrupted; // the debugger SIGINT breaks into
+
+static void onInterrupt(int sig)
+{
+    (void)sig;
+    interrupted->interrupt = 1;
+}
+
+static u16 fetch(Chip8* c8, u16 addr) { return c8->memory[addr & 0xFFF] << 8 | c8->memory[(addr + 1) & 0xFFF]; }
+
+//------------------------------------------------------------------------------
+//                               Views
+//------------------------------------------------------------------------------
+
+static void printListing(Chip8* c8, u16 addr, s32 count)
+{
+    Debugger* d = c8->debugger;
+    for (s32 i = 0; i < count && addr < 4095; ++i, addr += 2) {
+        char text[32];
+        u16  op = fetch(c8, addr);
+        disassemble(op, c8->profile, text, sizeof(text));
+        fprintf(d->out, "%c%c 0x%03X  %04X  %s\n", addr == c8->pc ? '>' : ' ', d->breakpoints[addr] ? '*' : ' ', addr,
+            op, text);
+    }
+}
+
+static void printRegisters(Chip8* c8)
+{
+    Debugger* d = c8->debugger;
+    for (s32 i = 0; i < 16; ++i)
+        fprintf(d->out, "V%X=%02X%s", i, c8->V[i], i == 7 || i == 15 ? "\n" : " ");
+    fprintf(d->out, "I=%03X PC=%03X SP=%X DT=%02X ST=%02X cycle=%llu\n", c8->I, c8->pc, c8->sp, c8->delay_timer,
+        c8->sound_timer, (unsigned long long)c8->cycles);
+    for (s32 i = c8->sp - 1; i >= 0 && i < 16; --i)
+        fprintf(d->out, "  #%d 0x%03X\n", i, c8->stack[i]);
+}
+
+static void printMemory(Chip8* c8, u16 addr, s32 len)
+{
+    Debugger* d = c8->debugger;
+    for (s32 i = 0; i < len && addr + i < 4096; ++i) {
+        if (i % 16 == 0) fprintf(d->out, "%s0x%03X:", i ? "\n" : "", addr + i);
+        fprintf(d->out, " %02X", c8->memory[addr + i]);
+    }
+    fprintf(d->out, "\n");
+}
+
+static void printInfo(Chip8* c8)
+{
+    Debugger* d = c8->debugger;
+    fprintf(d->out, "Breakpoints:");
+    for (s32 addr = 0; addr < 4096; ++addr)
+        if (d->breakpoints[addr]) fprintf(d->out, " 0x%03X", addr);
+    fprintf(d->out, "\nMemory watchpoints:");
+    for (s32 addr = 0; addr < 4096; ++addr)
+        if (d->watch_memory[addr]) fprintf(d->out, " 0x%03X", addr);
+    fprintf(d->out, "\nRegister watchpoints:");
+    for (s32 i = 0; i < 16; ++i)
+        if (d->watch_regs & (1 << i)) fprintf(d->out, " V%X", i);
+    if (d->watch_regs & WATCH_I) fprintf(d->out, " I");
+    if (d->watch_regs & WATCH_DT) fprintf(d->out, " DT");
+    if (d->watch_regs & WATCH_ST) fprintf(d->out, " ST");
+    fprintf(d->out, "\n");
+}
+
+static void printHelp(Debugger* d)
+{
+    fprintf(d->out, "c                 continue\n"
+                    "s                 step one instruction\n"
+                    "n                 step, stepping over 2NNN calls\n"
+                    "b ADDR            set a breakpoint\n"
+                    "d ADDR            delete a breakpoint\n"
+                    "w ADDR [LEN]      watch memory for writes\n"
+                    "w REG             watch V0-VF, I, DT or ST for changes\n"
+                    "uw ADDR [LEN]|REG remove a watchpoint\n"
+                    "set REG VALUE     set V0-VF, I, PC, DT or ST\n"
+                    "r                 show registers and the call stack\n"
+                    "l [ADDR] [N]      disassemble N instructions\n"
+                    "x ADDR [LEN]      dump memory\n"
+                    "i                 list breakpoints and watchpoints\n"
+                    "q                 quit\n");
+}
+
+//------------------------------------------------------------------------------
+//                               Commands
+//------------------------------------------------------------------------------
+
+// Returns the watch bit for a register name, or 0.
+static u32 registerBit(char* name)
+{
+    if ((name[0] == 'V' || name[0] == 'v') && name[1] && !name[2]) {
+        char* end;
+        s32   i = strtol(name + 1, &end, 16);
+        if (!*end) return 1 << i;
+    }
+    if (strcmp(name, "I") == 0 || strcmp(name, "i") == 0) return WATCH_I;
+    if (strcmp(name, "DT") == 0 || strcmp(name, "dt") == 0) return WATCH_DT;
+    if (strcmp(name, "ST") == 0 || strcmp(name, "st") == 0) return WATCH_ST;
+    return 0;
+}
+
+static void setRegister(Chip8* c8, char* name, s32 value)
+{
+    u32 bit = registerBit(name);
+    if (strcmp(name, "PC") == 0 || strcmp(name, "pc") == 0)
+        c8->pc = value & 0xFFF;
+    else if (bit == WATCH_I)
+        c8->I = value & 0xFFF;
+    else if (bit == WATCH_DT)
+        c8->delay_timer = value;
+    else if (bit == WATCH_ST)
+        c8->sound_timer = value;
+    else if (bit)
+        c8->V[__builtin_ctz(bit)] = value;
+    else
+        fprintf(c8->debugger->out, "Unknown register: %s\n", name);
+}
+
+static void watch(Debugger* d, char* what, char* len, bool on)
+{
+    u32 bit = registerBit(what);
+    if (bit) {
+        d->watch_regs = on ? d->watch_regs | bit : d->watch_regs & ~bit;
+        return;
+    }
+
+    char* end;
+    s32   addr = strtol(what, &end, 16);
+    if (end == what || *end || addr < 0 || addr > 0xFFF) {
+        fprintf(d->out, "Not a register or address: %s\n", what);
+        return;
+    }
+    s32 n = len ? strtol(len, NULL, 0) : 1;
+    for (s32 i = addr; i < addr + n && i < 4096; ++i) {
+        if (d->watch_memory[i] == on) continue;
+        d->watch_memory[i] = on;
+        d->watch_count += on ? 1 : -1;
+    }
+}
+
+// Drops every breakpoint and watch so the machine runs on unattended.
+static void release(Debugger* d)
+{
+    memset(d->breakpoints, 0, sizeof(d->breakpoints));
+    memset(d->watch_memory, 0, sizeof(d->watch_memory));
+    d->breakpoint_count = d->watch_count = d->watch_regs = 0;
+    d->stepping = d->stepping_over = false;
+}
+
+// The socket client went away. The terminal takes over the prompt, if there
+// is one, and the machine keeps running.
+static void disconnect(Debugger* d)
+{
+    fclose(d->in);
+    fclose(d->out);
+    d->in     = stdin;
+    d->out    = stdout;
+    d->socket = -1;
+    release(d);
+    info("Debugger disconnected");
+}
+
+void debugStop(Chip8* c8, char* reason)
+{
+    Debugger* d     = c8->debugger;
+    d->interrupt    = 0;
+    d->stepping     = false;
+    d->stepping_over = false;
+
+    if (reason) fprintf(d->out, "%s\n", reason);
+    printListing(c8, c8->pc, 1);
+
+    char line[256];
+    for (;;) {
+        fprintf(d->out, "(chip8) ");
+        fflush(d->out);
+
+        // Without a controlling terminal or a connected client there is
+        // nothing to wait for, so let the machine run.
+        if (!fgets(line, sizeof(line), d->in)) {
+            if (d->socket >= 0)
+                disconnect(d);
+            else
+                release(d);
+            return;
+        }
+
+        char* cmd = strtok(line, " \t\r\n");
+        char* a1  = strtok(NULL, " \t\r\n");
+        char* a2  = strtok(NULL, " \t\r\n");
+        if (!cmd) continue;
+
+        if (strcmp(cmd, "c") == 0) return;
+        if (strcmp(cmd, "s") == 0) {
+            d->stepping = true;
+            return;
+        }
+        if (strcmp(cmd, "n") == 0) {
+            if (decodeOpcode(fetch(c8, c8->pc), c8->profile) == OP_CALL) {
+                d->stepping_over = true;
+                d->step_over_pc  = c8->pc + 2;
+                d->step_over_sp  = c8->sp;
+            } else
+                d->stepping = true;
+            return;
+        }
+        if (strcmp(cmd, "q") == 0) exit(0);
+
+        if (strcmp(cmd, "b") == 0 && a1) {
+            s32 addr = strtol(a1, NULL, 16) & 0xFFF;
+            if (!d->breakpoints[addr]) ++d->breakpoint_count;
+            d->breakpoints[addr] = true;
+        } else if (strcmp(cmd, "d") == 0 && a1) {
+            s32 addr = strtol(a1, NULL, 16) & 0xFFF;
+            if (d->breakpoints[addr]) --d->breakpoint_count;
+            d->breakpoints[addr] = false;
+        } else if (strcmp(cmd, "w") == 0 && a1)
+            watch(d, a1, a2, true);
+        else if (strcmp(cmd, "uw") == 0 && a1)
+            watch(d, a1, a2, false);
+        else if (strcmp(cmd, "set") == 0 && a1 && a2)
+            setRegister(c8, a1, strtol(a2, NULL, 16));
+        else if (strcmp(cmd, "r") == 0)
+            printRegisters(c8);
+        else if (strcmp(cmd, "l") == 0)
+            printListing(c8, a1 ? strtol(a1, NULL, 16) : c8->pc, a2 ? strtol(a2, NULL, 0) : 10);
+        else if (strcmp(cmd, "x") == 0 && a1)
+            printMemory(c8, strtol(a1, NULL, 16) & 0xFFF, a2 ? strtol(a2, NULL, 0) : 16);
+        else if (strcmp(cmd, "i") == 0)
+            printInfo(c8);
+        else
+            printHelp(d);
+    }
+}
+
+//------------------------------------------------------------------------------
+//                               Execution
+//------------------------------------------------------------------------------
+
+s32 debugRunCycles(Chip8* c8, s32 budget)
+{
+    Debugger* d       = c8->debugger;
+    bool      resumed = false; // don't stop again at the breakpoint we just continued from
+    char      reason[64];
+
+    while (budget > 0) {
+        if (d->interrupt) {
+            debugStop(c8, "Interrupted");
+            resumed = true;
+        }
+        if (c8->state == CHIP8_IDLE) c8->state = CHIP8_RUNNING; // skipping loops is only an optimization
+        if (c8->state != CHIP8_RUNNING) break;
+
+        if (d->stepping || (d->stepping_over && c8->pc == d->step_over_pc && c8->sp == d->step_over_sp)) {
+            debugStop(c8, NULL);
+            resumed = true;
+        } else if (d->breakpoints[c8->pc] && !resumed) {
+            debugStop(c8, "Breakpoint");
+            resumed = true;
+        }
+        if (!debugActive(d)) break;
+        resumed = false;
+
+        // Note what the instruction may touch before it runs.
+        u16    op   = fetch(c8, c8->pc);
+        u16    pc   = c8->pc;
+        u16    lo   = c8->I;
+        OpKind kind = decodeOpcode(op, c8->profile);
+        s32    span = (d->watch_count && (op_info[kind].flags & OPF_WRITE_I)) ? opcodeMemorySpan(op, c8->profile) : 0;
+        u8  V[16];
+        u16 I  = c8->I;
+        u8  dt = c8->delay_timer, st = c8->sound_timer;
+        memcpy(V, c8->V, 16);
+
+        if (c8->tracer)
+            traceStep(c8);
+        else
+            emulateCycle(c8);
+        --budget;
+
+        if (c8->state == CHIP8_BREAK) {
+            c8->state = CHIP8_RUNNING;
+            snprintf(reason, sizeof(reason), "Unknown opcode 0x%04X", op);
+            debugStop(c8, reason);
+            resumed = true;
+            continue;
+        }
+
+        for (s32 i = 0; i < span; ++i) {
+            u16 addr = (lo + i) & 0xFFF;
+            if (!d->watch_memory[addr]) continue;
+            snprintf(reason, sizeof(reason), "Watchpoint: 0x%03X written by 0x%03X", addr, pc);
+            debugStop(c8, reason);
+            resumed = true;
+            break;
+        }
+
+        u32 changed = 0;
+        for (s32 i = 0; i < 16; ++i)
+            if (V[i] != c8->V[i]) changed |= 1 << i;
+        if (I != c8->I) changed |= WATCH_I;
+        if (dt != c8->delay_timer) changed |= WATCH_DT;
+        if (st != c8->sound_timer) changed |= WATCH_ST;
+        if (changed & d->watch_regs) {
+            snprintf(reason, sizeof(reason), "Watchpoint: register changed by 0x%03X", pc);
+            debugStop(c8, reason);
+            resumed = true;
+        }
+    }
+
+    return budget;
+}
+
+void debugPoll(Debugger* d)
+{
+    if (d->socket < 0) return;
+    struct pollfd p = { d->socket, POLLIN, 0 };
+    if (poll(&p, 1, 0) <= 0) return;
+
+    // Commands still queued are handled first. After that a closed
+    // connection reads as end of file, which is not a command.
+    char    c;
+    ssize_t n = recv(d->socket, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    if (n > 0)
+        d->interrupt = 1;
+    else if (n == 0 || (p.revents & (POLLHUP | POLLERR)))
+        disconnect(d);
+}
+
+//------------------------------------------------------------------------------
+//                               Setup
+//------------------------------------------------------------------------------
+
+void debugAttach(Chip8* c8, char* socket_path)
+{
+    Debugger* d = xcalloc(1, sizeof(Debugger));
+    d->in       = stdin;
+    d->out      = stdout;
+    d->socket   = -1;
+    d->stepping = true;
+
+    if (socket_path) {
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
+        unlink(socket_path);
+
+        s32 server = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (server < 0 || bind(server, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(server, 1) < 0)
+            error("Could not listen on %s", socket_path);
+
+        info("Waiting for a debugger to connect to %s", socket_path);
+        d->socket = accept(server, NULL, NULL);
+        if (d->socket < 0) error("Could not accept a debugger connection");
+        close(server);
+
+        d->in  = fdopen(d->socket, "r");
+        d->out = fdopen(dup(d->socket), "w");
+
+        // Writing to a client that has gone must fail, not kill the emulator.
+        signal(SIGPIPE, SIG_IGN);
+    }
+
+    interrupted = d;
+    signal(SIGINT, onInterrupt);
+
+    c8->debugger = d;
+}
@@ -0,0 +1,64 @@
+#ifndef DEBUG_H
+#define DEBUG_H
+
+#include "typedefs.h"
+#include <signal.h> // sig_atomic_t
+#include <stdio.h> // FILE
+
+struct Chip8;
+
+//------------------------------------------------------------------------------
+//                               Debugger
+//------------------------------------------------------------------------------
+
+// Register watchpoints use bits 0-15 for V0-VF and these for the rest.
+#define WATCH_I (1 << 16)
+#define WATCH_DT (1 << 17)
+#define WATCH_ST (1 << 18)
+
+typedef struct Debugger
+{
+    u8  breakpoints[4096];
+    s32 breakpoint_count;
+    u8  watch_memory[4096];
+    s32 watch_count;
+    u32 watch_regs;
+
+    bool stepping; // stop before the next instruction
+    bool stepping_over; // stop once the 2NNN being stepped over returns
+    u16  step_over_pc;
+    u16  step_over_sp;
+
+    volatile sig_atomic_t interrupt; // set from the SIGINT handler or by socket input
+
+    FILE* in;
+    FILE* out;
+    s32   socket; // -1 when driven from stdin
+} Debugger;
+
+// Attaches a debugger driven from stdin, or from the first client to connect
+// to a unix socket at 'socket_path' if it is not NULL. The machine stops
+// before its first instruction.
+void debugAttach(struct Chip8* c8, char* socket_path);
+
+// Whether anything needs checking between instructions. When this is false
+// runFrame() uses the plain interpreter loop and the debugger costs nothing.
+static inline bool debugActive(Debugger* d)
+{
+    return d->breakpoint_count || d->watch_count || d->watch_regs || d->stepping || d->stepping_over || d->interrupt;
+}
+
+// Runs up to 'budget' instructions, checking breakpoints and watchpoints around
+// each, and drops into the command prompt when one triggers. Returns the
+// number of cycles left over when the machine stopped running.
+s32 debugRunCycles(struct Chip8* c8, s32 budget);
+
+// Drops into the command prompt.
+void debugStop(struct Chip8* c8, char* reason);
+
+// Checks the socket for input while the machine runs. Called once per frame.
+// If the client has gone, its breakpoints and watches go with it and the
+// machine keeps running.
+void debugPoll(Debugger* d);
+
+#endif
@@ -0,0 +1,190 @@
+#include "display.h"
+#include <assert.h>
+#include <string.h> // memmove, memset
+
+// The bits of a row that are on screen at the current resolution.
+static u128 visible(Display* d) { return ~(u128)0 << (128 - d->width); }
+
+void displayInit(Display* d)
+{
+    d->planes = 1;
+    displaySetHires(d, false);
+}
+
+void displaySetHires(Display* d, bool hires)
+{
+    d->width  = hires ? 128 : 64;
+    d->height = hires ? 64 : 32;
+    memset(d->rows, 0, sizeof(d->rows));
+}
+
+void displayClear(Display* d)
+{
+    for (s32 p = 0; p < DISPLAY_PLANES; ++p)
+        if (d->planes & (1 << p)) memset(d->rows[p], 0, sizeof(d->rows[p]));
+}
+
+bool displayDraw(Display* d, u8* memory, u16 addr, s32 x, s32 y, s32 rows, s32 wide, bool wrap)
+{
+    u128 mask = visible(d);
+    bool hit  = false;
+    x %= d->width;
+    y %= d->height;
+
+    for (s32 p = 0; p < DISPLAY_PLANES; ++p) {
+        if (!(d->planes & (1 << p))) continue;
+
+        for (s32 r = 0; r < rows; ++r, addr += wide / 8) {
+            s32 row = y + r;
+            if (row >= d->height) {
+                if (!wrap) continue;
+                row -= d->height;
+            }
+
+            u32 bits = memory[addr & 0xFFF];
+            if (wide == 16) bits = bits << 8 | memory[(addr + 1) & 0xFFF];
+
+            // The sprite row at column 0, then moved to x. Whatever falls off
+            // the right edge comes back in on the left when wrapping.
+            u128 sprite = (u128)bits << (128 - wide);
+            u128 m      = (sprite >> x) & mask;
+            if (wrap && x + wide > d->width) m |= sprite << (d->width - x);
+
+            hit |= (d->rows[p][row] & m) != 0;
+            d->rows[p][row] ^= m;
+        }
+    }
+    return hit;
+}
+
+void displayScroll(Display* d, s32 dx, s32 dy)
+{
+    u128 mask = visible(d);
+    s32  h    = d->height;
+    if (dy > h) dy = h;
+    if (dy < -h) dy = -h;
+
+    for (s32 p = 0; p < DISPLAY_PLANES; ++p) {
+        if (!(d->planes & (1 << p))) continue;
+        u128* rows = d->rows[p];
+
+        if (dy > 0) {
+            memmove(rows + dy, rows, (h - dy) * sizeof(u128));
+            memset(rows, 0, dy * sizeof(u128));
+        } else if (dy < 0) {
+            memmove(rows, rows - dy, (h + dy) * sizeof(u128));
+            memset(rows + h + dy, 0, -dy * sizeof(u128));
+        }
+
+        if (dx > 0)
+            for (s32 y = 0; y < h; ++y)
+                rows[y] = (rows[y] >> dx) & mask;
+        else if (dx < 0)
+            for (s32 y = 0; y < h; ++y)
+                rows[y] = (rows[y] << -dx) & mask;
+    }
+}
+
+//------------------------------------------------------------------------------
+//                               Tests
+//------------------------------------------------------------------------------
+
+// Number of lit pixels in the first plane.
+static s32 litPixels(Display* d)
+{
+    s32 n = 0;
+    for (s32 y = 0; y < DISPLAY_MAX_HEIGHT; ++y)
+        n += __builtin_popcountll((u64)(d->rows[0][y] >> 64)) + __builtin_popcountll((u64)d->rows[0][y]);
+    return n;
+}
+
+void display_tests(void)
+{
+    static Display d;
+    static u8      memory[4096];
+    memset(memory, 0xFF, 64); // solid sprites, 8 or 16 wide
+    memory[0x40] = 0xF0; // one row per plane
+    memory[0x41] = 0x0F;
+
+    // The right edge clips, or wraps to the left
+    displayInit(&d);
+    assert(!displayDraw(&d, memory, 0, 60, 0, 1, 8, false));
+    assert(displayPixel(&d, 63, 0) == 1 && displayPixel(&d, 0, 0) == 0 && litPixels(&d) == 4);
+    displayInit(&d);
+    displayDraw(&d, memory, 0, 60, 0, 1, 8, true);
+    assert(displayPixel(&d, 63, 0) == 1 && displayPixel(&d, 3, 0) == 1 && litPixels(&d) == 8);
+
+    // So does the bottom edge
+    displayInit(&d);
+    displayDraw(&d, memory, 0, 0, 30, 4, 8, false);
+    assert(displayPixel(&d, 0, 31) == 1 && displayPixel(&d, 0, 0) == 0 && litPixels(&d) == 16);
+    displayInit(&d);
+    displayDraw(&d, memory, 0, 0, 30, 4, 8, true);
+    assert(displayPixel(&d, 0, 31) == 1 && displayPixel(&d, 0, 1) == 1 && litPixels(&d) == 32);
+
+    // The position itself always wraps
+    displayInit(&d);
+    displayDraw(&d, memory, 0, 64 + 2, 32 + 1, 1, 8, false);
+    assert(displayPixel(&d, 2, 1) == 1 && litPixels(&d) == 8);
+
+    // Turning a pixel off is a collision, turning one on is not
+    assert(displayDraw(&d, memory, 0, 9, 1, 1, 8, false));
+    assert(displayPixel(&d, 9, 1) == 0 && displayPixel(&d, 10, 1) == 1 && litPixels(&d) == 7 + 7);
+    assert(!displayDraw(&d, memory, 0, 40, 20, 1, 8, false));
+
+    // 16x16 sprites in both resolutions
+    displayInit(&d);
+    displayDraw(&d, memory, 0, 56, 24, 16, 16, false);
+    assert(displayPixel(&d, 63, 31) == 1 && displayPixel(&d, 55, 24) == 0 && litPixels(&d) == 8 * 8);
+    displaySetHires(&d, true);
+    assert(litPixels(&d) == 0);
+    displayDraw(&d, memory, 0, 120, 56, 16, 16, false);
+    assert(displayPixel(&d, 127, 63) == 1 && displayPixel(&d, 119, 56) == 0 && litPixels(&d) == 8 * 8);
+    displayDraw(&d, memory, 0, 0, 0, 16, 16, true);
+    assert(displayPixel(&d, 15, 15) == 1 && displayPixel(&d, 16, 0) == 0 && litPixels(&d) == 8 * 8 + 16 * 16);
+
+    // Each selected plane takes its own rows of the sprite, and clearing
+    // only touches the selected planes
+    displayInit(&d);
+    d.planes = 3;
+    displayDraw(&d, memory, 0x40, 0, 0, 1, 8, false);
+    assert(displayPixel(&d, 0, 0) == 1 && displayPixel(&d, 4, 0) == 2);
+    d.planes = 2;
+    assert(!displayDraw(&d, memory, 0x40, 0, 0, 1, 8, false)); // the plane 1 row is the first byte now
+    assert(displayPixel(&d, 0, 0) == 3 && displayPixel(&d, 4, 0) == 2);
+    assert(displayDraw(&d, memory, 0x40, 0, 0, 1, 8, false));
+    assert(displayPixel(&d, 0, 0) == 1 && displayPixel(&d, 4, 0) == 2);
+    displayClear(&d);
+    assert(displayPixel(&d, 0, 0) == 1 && displayPixel(&d, 4, 0) == 0);
+    d.planes = 1;
+    displayClear(&d);
+    assert(displayPixel(&d, 0, 0) == 0);
+
+    // Scrolling: 00CN, 00DN, 00FB and 00FC in both resolutions, with whole
+    // pixels in low resolution and nothing coming back in at the edges
+    for (s32 hires = 0; hires < 2; ++hires) {
+        displayInit(&d);
+        displaySetHires(&d, hires);
+        s32 w = d.width, h = d.height;
+        displayDraw(&d, memory, 0, 0, 0, 1, 8, false); // pixels 0-7 of row 0
+
+        displayScroll(&d, 0, 1); // 00C1
+        assert(displayPixel(&d, 0, 1) == 1 && displayPixel(&d, 0, 0) == 0);
+        displayScroll(&d, 0, 3); // 00C3
+        assert(displayPixel(&d, 0, 4) == 1);
+        displayScroll(&d, 0, -2); // 00D2
+        assert(displayPixel(&d, 0, 2) == 1 && displayPixel(&d, 0, 4) == 0);
+        displayScroll(&d, 4, 0); // 00FB
+        assert(displayPixel(&d, 4, 2) == 1 && displayPixel(&d, 3, 2) == 0 && displayPixel(&d, 11, 2) == 1);
+        displayScroll(&d, -4, 0); // 00FC
+        assert(displayPixel(&d, 0, 2) == 1 && displayPixel(&d, 8, 2) == 0 && litPixels(&d) == 8);
+
+        displayScroll(&d, -4, 0); // off the left edge
+        assert(litPixels(&d) == 4);
+        displayDraw(&d, memory, 0, w - 8, 2, 1, 8, false);
+        displayScroll(&d, 4, 0); // off the right edge, not into the unused bits
+        assert(litPixels(&d) == 4 + 4 && displayPixel(&d, w - 1, 2) == 1);
+        displayScroll(&d, 0, h - 2); // off the bottom
+        assert(litPixels(&d) == 0);
+    }
+}
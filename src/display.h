@@ -0,0 +1,61 @@
+#ifndef DISPLAY_H
+#define DISPLAY_H
+
+#include "typedefs.h"
+
+//------------------------------------------------------------------------------
+//                               Display
+//------------------------------------------------------------------------------
+
+// 64x32 in low resolution, 128x64 in the SUPER-CHIP high resolution mode.
+#define DISPLAY_MAX_WIDTH 128
+#define DISPLAY_MAX_HEIGHT 64
+
+// XO-CHIP has two bitplanes, giving four colours.
+#define DISPLAY_PLANES 2
+
+// Each row of a plane is packed into one 128 bit word with column 0 in the
+// most significant bit, the same order as sprite bits. A low resolution row
+// only uses the top 64 bits. Drawing a sprite row is a shift and an XOR, and
+// scrolling is a shift per row or a memmove of whole rows.
+typedef struct
+{
+    u128 rows[DISPLAY_PLANES][DISPLAY_MAX_HEIGHT];
+    u8   width;
+    u8   height;
+    u8   planes; // mask of the planes that drawing, clearing and scrolling affect (FN01)
+} Display;
+
+// Low resolution, first plane selected, everything blank.
+void displayInit(Display* d);
+
+// Switches resolution (00FE/00FF), which also clears every plane.
+void displaySetHires(Display* d, bool hires);
+
+void displayClear(Display* d);
+
+// XORs a sprite read from 'memory' at 'addr' onto the selected planes at
+// (x, y), 'wide' bits (8 or 16) by 'rows' rows. Each selected plane takes
+// the next rows * wide / 8 bytes. The position wraps around the screen;
+// pixels past the edges are clipped, or wrapped if 'wrap' is set.
+// Returns whether any pixel was turned off.
+bool displayDraw(Display* d, u8* memory, u16 addr, s32 x, s32 y, s32 rows, s32 wide, bool wrap);
+
+// Scrolls the selected planes 'dx' columns right (left if negative) and 'dy'
+// rows down (up if negative), filling with blank pixels. The distances are in
+// pixels of the current resolution, so in low resolution an odd 00CN moves
+// whole pixels rather than the half pixels of the original SUPER-CHIP.
+void displayScroll(Display* d, s32 dx, s32 dy);
+
+// Plane bits of the pixel at (x, y), one bit per plane.
+static inline u8 displayPixel(Display* d, s32 x, s32 y)
+{
+    u8 color = 0;
+    for (s32 p = 0; p < DISPLAY_PLANES; ++p)
+        color |= ((d->rows[p][y] >> (127 - x)) & 1) << p;
+    return color;
+}
+
+void display_tests(void);
+
+#endif
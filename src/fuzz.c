@@ -0,0 +1,389 @@
+#include "fuzz.h"
+#include "chip8.h"
+#include "utility.h"
+#include <pthread.h>
+#include <stdio.h> // snprintf
+#include <stdlib.h> // free
+#include <string.h> // memset
+#include <time.h> // nanosleep
+#include <unistd.h> // sysconf
+
+#define FUZZ_FRAMES 300 // five seconds of emulated time per test case
+#define FUZZ_MAX_EVENTS 64
+#define FUZZ_CORPUS_SIZE 4096 // each entry holds a whole machine
+#define FUZZ_SCREENS (1 << 16) // framebuffer hashes remembered, a power of two
+#define FUZZ_SEED 0xC8C8C8C8u
+
+typedef struct
+{
+    u16 frame; // applied before this frame runs
+    u8  key;
+    u8  down;
+} KeyEvent;
+
+typedef struct
+{
+    KeyEvent events[FUZZ_MAX_EVENTS];
+    s32      count; // sorted by frame
+} TestCase;
+
+// An input that found something new, and the machine it left behind, from
+// which later inputs continue. Entries are written once, before
+// corpus_count is raised past them.
+typedef struct
+{
+    TestCase input;
+    s32      parent; // entry whose end state the input starts from, -1 for the loaded ROM
+    Chip8    end;
+} CorpusEntry;
+
+typedef struct
+{
+    Chip8 base; // the machine right after loading, where the first inputs start
+
+    CorpusEntry*    corpus;
+    s32             corpus_count;
+    pthread_mutex_t corpus_lock;
+
+    u8  coverage[4096]; // hit count buckets seen at each instruction address, see bucket()
+    u64 screens[FUZZ_SCREENS]; // open addressing set of framebuffer hashes, 0 is empty
+    u8  faults[FAULT_COUNT][4096]; // distinct (fault, pc) pairs found
+
+    u64 execs;
+    u32 covered; // addresses executed at all
+    u32 coverage_events; // test cases that set new coverage bits
+    u32 screen_count;
+    u32 fault_count;
+    u32 stopping;
+} Fuzzer;
+
+typedef struct
+{
+    Fuzzer*  fuzzer;
+    u32      rng;
+    u8       hits[4096]; // executions per address in this run, saturating
+    Chip8    machine;
+    TestCase input;
+    s32      parent; // corpus entry 'input' continues from
+} Worker;
+
+static u32 nextRandom(u32* state)
+{
+    u32 x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+static u32 below(Worker* w, u32 n) { return nextRandom(&w->rng) % n; }
+
+//------------------------------------------------------------------------------
+//                               Feedback
+//------------------------------------------------------------------------------
+
+static u64 hashDisplay(Display* d)
+{
+    u64 h = 0xCBF29CE484222325ull ^ d->width;
+    for (s32 p = 0; p < DISPLAY_PLANES; ++p)
+        for (s32 y = 0; y < d->height; ++y) {
+            h = (h ^ (u64)(d->rows[p][y] >> 64)) * 0x100000001B3ull;
+            h = (h ^ (u64)d->rows[p][y]) * 0x100000001B3ull;
+        }
+    return h | 1;
+}
+
+// Adds a framebuffer hash to the set. Returns whether it was new.
+static bool addScreen(Fuzzer* f, u64 h)
+{
+    for (u32 i = 0, slot = h & (FUZZ_SCREENS - 1); i < 64; ++i, slot = (slot + 1) & (FUZZ_SCREENS - 1)) {
+        u64 seen = __atomic_load_n(&f->screens[slot], __ATOMIC_RELAXED);
+        if (seen == h) return false;
+        if (seen == 0) {
+            if (__atomic_compare_exchange_n(&f->screens[slot], &seen, h, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                __atomic_fetch_add(&f->screen_count, 1, __ATOMIC_RELAXED);
+                return true;
+            }
+            if (seen == h) return false;
+        }
+    }
+    return false; // the neighbourhood is full; treat it as seen
+}
+
+// Hit counts are compared in classes, so a loop running a few more times
+// is not new but one running an order of magnitude longer is.
+static u8 bucket(u8 hits)
+{
+    if (hits <= 3) return hits == 3 ? 4 : hits;
+    if (hits < 8) return 8;
+    if (hits < 16) return 16;
+    if (hits < 32) return 32;
+    if (hits < 128) return 64;
+    return 128;
+}
+
+// Prints every key event from the ROM load up to the end of 't': those of
+// the entries it continues from, then its own, as frame:key+ or frame:key-.
+static s32 printInput(char* buf, s32 size, Fuzzer* f, s32 parent, TestCase* t)
+{
+    s32    len   = 0;
+    Chip8* start = &f->base;
+    if (parent >= 0) {
+        len   = printInput(buf, size, f, f->corpus[parent].parent, &f->corpus[parent].input);
+        start = &f->corpus[parent].end;
+    }
+    for (s32 i = 0; i < t->count && len < size; ++i)
+        len += snprintf(buf + len, size - len, " %llu:%X%c", (unsigned long long)(start->frames + t->events[i].frame),
+            t->events[i].key, t->events[i].down ? '+' : '-');
+    return len;
+}
+
+//------------------------------------------------------------------------------
+//                               Execution
+//------------------------------------------------------------------------------
+
+// runFrame() with every executed address counted in 'hits'. Skipped idle
+// loop iterations are not counted, which only ever makes a count smaller.
+static void runFrameCovered(Chip8* c8, u8* hits)
+{
+    wakeOnKey(c8);
+
+    s32 budget = CYCLES_PER_FRAME;
+    while (budget > 0) {
+        if (c8->state == CHIP8_IDLE) {
+            budget = c8->run(c8, budget);
+            continue;
+        }
+        if (c8->state != CHIP8_RUNNING) break;
+        if (hits[c8->pc & 0xFFF] < 255) ++hits[c8->pc & 0xFFF];
+        c8->step(c8);
+        --budget;
+    }
+
+    updateTimers(c8);
+}
+
+// Runs a test case from the end state of corpus entry 'parent', or from the
+// loaded ROM. Returns whether it set new coverage bits or found a new fault.
+static bool execute(Worker* w, s32 parent, TestCase* t)
+{
+    Fuzzer* f  = w->fuzzer;
+    Chip8*  c8 = &w->machine;
+    snapshotMachine(c8, parent < 0 ? &f->base : &f->corpus[parent].end);
+    memset(w->hits, 0, sizeof(w->hits));
+
+    bool novel = false;
+    s32  next  = 0;
+    for (u32 frame = 0; frame < FUZZ_FRAMES; ++frame) {
+        for (; next < t->count && t->events[next].frame == frame; ++next) {
+            if (t->events[next].down)
+                keypad_press(&c8->keypad, t->events[next].key, c8->cycles);
+            else
+                keypad_release(&c8->keypad, t->events[next].key);
+        }
+
+        runFrameCovered(c8, w->hits);
+
+        // New pictures are counted, but an animation alone makes a new one
+        // every frame, so they don't make the input interesting.
+        if (c8->drawFlag) {
+            c8->drawFlag = false;
+            addScreen(f, hashDisplay(&c8->display));
+        }
+
+        if (c8->state == CHIP8_FAULT || c8->state == CHIP8_HALTED) break;
+        if (c8->state == CHIP8_WAIT_KEY && next == t->count) break; // nothing left to wake it
+    }
+
+    if (c8->state == CHIP8_FAULT && !__atomic_exchange_n(&f->faults[c8->fault][c8->pc], 1, __ATOMIC_RELAXED)) {
+        __atomic_fetch_add(&f->fault_count, 1, __ATOMIC_RELAXED);
+        char input[1024] = " none";
+        printInput(input, sizeof(input), f, parent, t);
+        warning("%s at 0x%03X after %llu frames, sp %d, I 0x%X, input %s", chip8_fault_names[c8->fault], c8->pc,
+            (unsigned long long)c8->frames, c8->sp, c8->I, input + 1);
+        novel = true;
+    }
+
+    u32  reached = 0;
+    bool bits    = false;
+    for (s32 pc = 0; pc < 4096; ++pc) {
+        u8 b = bucket(w->hits[pc]);
+        if (!(b & ~__atomic_load_n(&f->coverage[pc], __ATOMIC_RELAXED))) continue;
+        u8 seen = __atomic_fetch_or(&f->coverage[pc], b, __ATOMIC_RELAXED);
+        if (!(b & ~seen)) continue;
+        bits = true;
+        if (!seen) ++reached;
+    }
+    if (reached) __atomic_fetch_add(&f->covered, reached, __ATOMIC_RELAXED);
+    if (bits) {
+        __atomic_fetch_add(&f->coverage_events, 1, __ATOMIC_RELAXED);
+        novel = true;
+    }
+
+    return novel;
+}
+
+//------------------------------------------------------------------------------
+//                               Mutation
+//------------------------------------------------------------------------------
+
+static void sortEvents(TestCase* t)
+{
+    for (s32 i = 1; i < t->count; ++i) {
+        KeyEvent e = t->events[i];
+        s32      j = i;
+        for (; j > 0 && t->events[j - 1].frame > e.frame; --j)
+            t->events[j] = t->events[j - 1];
+        t->events[j] = e;
+    }
+}
+
+static void removeEvent(TestCase* t, s32 i)
+{
+    memmove(t->events + i, t->events + i + 1, (t->count - i - 1) * sizeof(KeyEvent));
+    --t->count;
+}
+
+// A key press with its release up to half a second later.
+static void addTap(Worker* w, TestCase* t)
+{
+    if (t->count + 2 > FUZZ_MAX_EVENTS) return;
+    u16 frame  = below(w, FUZZ_FRAMES - 1);
+    u16 length = 1 + below(w, 30);
+    u8  key    = below(w, 16);
+
+    t->events[t->count++] = (KeyEvent){ frame, key, 1 };
+    if (frame + length < FUZZ_FRAMES) t->events[t->count++] = (KeyEvent){ frame + length, key, 0 };
+}
+
+static void mutate(Worker* w, TestCase* t)
+{
+    Fuzzer* f      = w->fuzzer;
+    s32     rounds = 1 + below(w, 4);
+
+    for (s32 r = 0; r < rounds; ++r) {
+        switch (t->count ? below(w, 5) : 0) {
+        case 0: addTap(w, t); break;
+        case 1: removeEvent(t, below(w, t->count)); break;
+        case 2: t->events[below(w, t->count)].key = below(w, 16); break;
+        case 3: {
+            KeyEvent* e     = &t->events[below(w, t->count)];
+            s32       frame = e->frame + (s32)below(w, 61) - 30;
+            e->frame        = frame < 0 ? 0 : frame >= FUZZ_FRAMES ? FUZZ_FRAMES - 1 : frame;
+        } break;
+        case 4: {
+            // Splice: keep this case up to a frame, take another one from there on.
+            s32       count = __atomic_load_n(&f->corpus_count, __ATOMIC_ACQUIRE);
+            TestCase* other = &f->corpus[below(w, count)].input;
+            u16       cut   = below(w, FUZZ_FRAMES);
+            s32       keep  = 0;
+            while (keep < t->count && t->events[keep].frame < cut)
+                ++keep;
+            t->count = keep;
+            for (s32 i = 0; i < other->count && t->count < FUZZ_MAX_EVENTS; ++i)
+                if (other->events[i].frame >= cut) t->events[t->count++] = other->events[i];
+        } break;
+        }
+        sortEvents(t);
+    }
+}
+
+//------------------------------------------------------------------------------
+//                               Workers
+//------------------------------------------------------------------------------
+
+static void addToCorpus(Fuzzer* f, s32 parent, TestCase* t, Chip8* end)
+{
+    pthread_mutex_lock(&f->corpus_lock);
+    s32 count = f->corpus_count;
+    if (count < FUZZ_CORPUS_SIZE) {
+        CorpusEntry* e = &f->corpus[count];
+        e->input       = *t;
+        e->parent      = parent;
+        snapshotMachine(&e->end, end);
+        __atomic_store_n(&f->corpus_count, count + 1, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&f->corpus_lock);
+}
+
+static void* worker(void* arg)
+{
+    Worker* w = arg;
+    Fuzzer* f = w->fuzzer;
+
+    while (!__atomic_load_n(&f->stopping, __ATOMIC_RELAXED)) {
+        s32          count = __atomic_load_n(&f->corpus_count, __ATOMIC_ACQUIRE);
+        s32          pick  = below(w, count);
+        CorpusEntry* e     = &f->corpus[pick];
+
+        // Half the time carry on from where the entry left the machine with
+        // fresh input, which is how the search gets past its first few
+        // seconds. Otherwise vary the entry's own input.
+        bool alive = e->end.state != CHIP8_FAULT && e->end.state != CHIP8_HALTED;
+        if (alive && below(w, 2)) {
+            w->parent      = pick;
+            w->input.count = 0;
+        } else {
+            w->parent = e->parent;
+            w->input  = e->input;
+        }
+        mutate(w, &w->input);
+
+        if (execute(w, w->parent, &w->input)) addToCorpus(f, w->parent, &w->input, &w->machine);
+        __atomic_fetch_add(&f->execs, 1, __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
+
+s32 runFuzzer(char* rom, s32 profile, s32 threads, u32 seconds)
+{
+    if (threads <= 0) threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+    Fuzzer* f = xcalloc(1, sizeof(Fuzzer));
+    f->corpus = xcalloc(FUZZ_CORPUS_SIZE, sizeof(CorpusEntry));
+    pthread_mutex_init(&f->corpus_lock, NULL);
+
+    initilize(&f->base);
+    setProfile(&f->base, profile);
+    loadGame(&f->base, rom);
+    seedRandom(&f->base, FUZZ_SEED);
+
+    // The empty input is the first corpus entry.
+    Worker*  workers  = xcalloc(threads, sizeof(Worker));
+    TestCase nothing  = { { { 0 } }, 0 };
+    workers[0].fuzzer = f;
+    execute(&workers[0], -1, &nothing);
+    addToCorpus(f, -1, &nothing, &workers[0].machine);
+
+    pthread_t* pool = xmalloc(sizeof(pthread_t) * threads);
+    for (s32 i = 0; i < threads; ++i) {
+        workers[i].fuzzer = f;
+        workers[i].rng    = FUZZ_SEED + i * 0x9E3779B9u;
+        pthread_create(&pool[i], NULL, worker, &workers[i]);
+    }
+
+    u64 start = get_time_ns(), last_execs = 0, last = start;
+    for (u32 s = 0; s < seconds; ++s) {
+        sleep_until_ns(start + (s + 1) * 1000000000ull);
+        u64 now   = get_time_ns();
+        u64 execs = __atomic_load_n(&f->execs, __ATOMIC_RELAXED);
+        info("[%us] %llu execs, %.0f/s, corpus %d, %u addresses covered (%u new coverage events), %u screens, "
+             "%u faults",
+            s + 1, (unsigned long long)execs, (execs - last_execs) / ((now - last) / 1.0e9), f->corpus_count,
+            f->covered, f->coverage_events, f->screen_count, f->fault_count);
+        last_execs = execs;
+        last       = now;
+    }
+
+    __atomic_store_n(&f->stopping, 1, __ATOMIC_RELAXED);
+    for (s32 i = 0; i < threads; ++i)
+        pthread_join(pool[i], NULL);
+
+    s32 faults = f->fault_count;
+    pthread_mutex_destroy(&f->corpus_lock);
+    free(pool);
+    free(workers);
+    free(f->corpus);
+    free(f);
+    return faults;
+}
@@ -0,0 +1,17 @@
+#ifndef FUZZ_H
+#define FUZZ_H
+
+#include "typedefs.h"
+
+// Explores a ROM by mutating timed key input sequences. The first test cases
+// start from a copy of the machine taken after loading, with a fixed random
+// seed, so a case always plays out the same way. Cases that execute an
+// instruction address a new number of times (in powers of two) join the
+// corpus together with the machine they left behind. Later cases either
+// vary a corpus input or continue from a corpus machine with new input, so
+// the search reaches further than one input from the start. Runs on 'threads' threads (all cores
+// if 0) for 'seconds', printing progress every second and every fault found
+// with the input that caused it. Returns the number of distinct faults.
+s32 runFuzzer(char* rom, s32 profile, s32 threads, u32 seconds);
+
+#endif
@@ -0,0 +1,128 @@
+#include "input.h"
+#include "utility.h"
+#include <assert.h>
+#include <ctype.h> // toupper
+#include <string.h> // memset, strlen
+
+//------------------------------------------------------------------------------
+//                               Keypad
+//------------------------------------------------------------------------------
+
+void keypad_reset(Keypad* kp) { memset(kp, 0, sizeof(Keypad)); }
+
+void keypad_press(Keypad* kp, u8 key, u64 cycle)
+{
+    key &= 0xF;
+    kp->press_cycle[key] = cycle;
+    kp->press_time[key]  = get_time_ns();
+
+    // Publish the timestamps before the bits so an observer never pairs a
+    // new press with a stale timestamp.
+    __atomic_fetch_or(&kp->pending, 1 << key, __ATOMIC_RELEASE);
+    __atomic_fetch_or(&kp->state, 1 << key, __ATOMIC_RELEASE);
+}
+
+void keypad_release(Keypad* kp, u8 key) { __atomic_fetch_and(&kp->state, ~(1 << (key & 0xF)), __ATOMIC_RELEASE); }
+
+void keypad_observe(Keypad* kp, u16 mask, u64 cycle)
+{
+    // Only the observer that actually clears a pending bit records it.
+    u16 seen = __atomic_fetch_and(&kp->pending, ~mask, __ATOMIC_ACQUIRE) & mask;
+    if (!seen) return;
+
+    u64 now = get_time_ns();
+    for (s32 key = 0; key < 16; ++key) {
+        if (!(seen & (1 << key))) continue;
+
+        u64 cycles = cycle - kp->press_cycle[key];
+        u64 ns     = now - kp->press_time[key];
+
+        KeyLatency* l = &kp->latency;
+        ++l->count;
+        l->cycles_sum += cycles;
+        l->ns_sum += ns;
+        if (cycles > l->cycles_max) l->cycles_max = cycles;
+        if (ns > l->ns_max) l->ns_max = ns;
+    }
+}
+
+void keypad_report(Keypad* kp)
+{
+    KeyLatency* l = &kp->latency;
+    if (l->count == 0) return;
+    info("Input latency over %llu presses: avg %.1f cycles / %.3f ms, max %llu cycles / %.3f ms",
+        (unsigned long long)l->count, (f64)l->cycles_sum / l->count, l->ns_sum / 1.0e6 / l->count,
+        (unsigned long long)l->cycles_max, l->ns_max / 1.0e6);
+}
+
+//------------------------------------------------------------------------------
+//                               Key Map
+//------------------------------------------------------------------------------
+
+// The hex keypad is laid out as
+//   1 2 3 C
+//   4 5 6 D
+//   7 8 9 E
+//   A 0 B F
+static u8 keypad_order[16] = { 0x1, 0x2, 0x3, 0xC, 0x4, 0x5, 0x6, 0xD, 0x7, 0x8, 0x9, 0xE, 0xA, 0x0, 0xB, 0xF };
+
+s32 keymap[16] = {
+    'X', '1', '2', '3', // 0 1 2 3
+    'Q', 'W', 'E', 'A', // 4 5 6 7
+    'S', 'D', 'Z', 'C', // 8 9 A B
+    '4', 'R', 'F', 'V', // C D E F
+};
+
+bool keymap_set_layout(char* layout)
+{
+    if (strlen(layout) != 16) return false;
+
+    // A host key can only stand for one chip-8 key.
+    for (s32 i = 0; i < 16; ++i)
+        for (s32 j = 0; j < i; ++j)
+            if (toupper((u8)layout[i]) == toupper((u8)layout[j])) return false;
+
+    for (s32 i = 0; i < 16; ++i)
+        keymap[keypad_order[i]] = toupper((u8)layout[i]);
+    return true;
+}
+
+s32 keymap_lookup(s32 host_key)
+{
+    for (s32 key = 0; key < 16; ++key)
+        if (keymap[key] == host_key) return key;
+    return -1;
+}
+
+//------------------------------------------------------------------------------
+//                               Tests
+//------------------------------------------------------------------------------
+
+void input_tests(void)
+{
+    // Press and release, and latency measured from the press to the first read
+    static Keypad kp;
+    keypad_reset(&kp);
+    assert(keypad_any_down(&kp, 0) == -1);
+    keypad_press(&kp, 0x3, 100);
+    keypad_press(&kp, 0xA, 100);
+    assert(!keypad_is_down(&kp, 0x4, 105));
+    assert(keypad_is_down(&kp, 0x3, 110));
+    assert(kp.latency.count == 1 && kp.latency.cycles_max == 10);
+    assert(keypad_any_down(&kp, 120) == 0xA);
+    assert(kp.latency.count == 2 && kp.latency.cycles_max == 20 && !kp.pending);
+    keypad_release(&kp, 0xA);
+    assert(!keypad_is_down(&kp, 0xA, 130) && keypad_any_down(&kp, 130) == 0x3);
+    keypad_release(&kp, 0x3);
+    assert(keypad_any_down(&kp, 140) == -1 && kp.latency.count == 2);
+
+    // Layouts are case-insensitive, and rejected whole if they repeat a key
+    s32 saved[16];
+    memcpy(saved, keymap, sizeof(keymap));
+    assert(keymap_set_layout("1234qwerasdfzxcv"));
+    assert(keymap_lookup('Q') == 0x4 && keymap_lookup('X') == 0x0 && keymap_lookup('V') == 0xF);
+    assert(!keymap_set_layout("1234qwerasdfzxcq"));
+    assert(!keymap_set_layout("1234QWERASDFZXC"));
+    assert(keymap_lookup('V') == 0xF && keymap_lookup('Q') == 0x4);
+    memcpy(keymap, saved, sizeof(keymap));
+}
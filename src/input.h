@@ -0,0 +1,73 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include "typedefs.h"
+
+//------------------------------------------------------------------------------
+//                               Keypad
+//------------------------------------------------------------------------------
+
+// Latency between a key going down on the host and the program first
+// observing it through EX9E, EXA1 or FX0A.
+typedef struct
+{
+    u64 count;
+    u64 cycles_sum;
+    u64 cycles_max;
+    u64 ns_sum;
+    u64 ns_max;
+} KeyLatency;
+
+typedef struct
+{
+    u16 state; // bit k is set while chip-8 key k is held
+    u16 pending; // keys pressed but not yet observed by the program
+
+    u64 press_cycle[16];
+    u64 press_time[16];
+
+    KeyLatency latency;
+} Keypad;
+
+void keypad_reset(Keypad* kp);
+
+// These may be called from a different thread than the one running the machine.
+void keypad_press(Keypad* kp, u8 key, u64 cycle);
+void keypad_release(Keypad* kp, u8 key);
+
+void keypad_observe(Keypad* kp, u16 mask, u64 cycle);
+void keypad_report(Keypad* kp);
+
+// Returns true if 'key' is held.
+static inline bool keypad_is_down(Keypad* kp, u8 key, u64 cycle)
+{
+    u16 bit  = 1 << (key & 0xF);
+    u16 down = __atomic_load_n(&kp->state, __ATOMIC_ACQUIRE) & bit;
+    if (down & __atomic_load_n(&kp->pending, __ATOMIC_RELAXED)) keypad_observe(kp, down, cycle);
+    return down != 0;
+}
+
+// Returns the highest held key, or -1 if none is held.
+static inline s32 keypad_any_down(Keypad* kp, u64 cycle)
+{
+    u16 down = __atomic_load_n(&kp->state, __ATOMIC_ACQUIRE);
+    if (!down) return -1;
+    if (down & __atomic_load_n(&kp->pending, __ATOMIC_RELAXED)) keypad_observe(kp, down, cycle);
+    return 31 - __builtin_clz(down);
+}
+
+//------------------------------------------------------------------------------
+//                               Key Map
+//------------------------------------------------------------------------------
+
+// Host keys are GLFW key codes, which are plain uppercase ASCII for the
+// printable keys, so the map is stored and configured as characters.
+extern s32 keymap[16];
+
+// 'layout' is 16 host keys given in keypad order: 123C 456D 789E A0BF
+bool keymap_set_layout(char* layout);
+s32  keymap_lookup(s32 host_key);
+
+void input_tests(void);
+
+#endif
@@ -0,0 +1,243 @@
+#include "log.h"
+#include "utility.h"
+#include <pthread.h>
+#include <stdio.h> // snprintf, fputs
+#include <stdlib.h> // atexit
+#include <string.h> // memcpy
+#include <time.h> // nanosleep
+
+#define LOG_RING_SIZE 1024 // records per thread, a power of two
+#define LOG_LINE_SIZE 512
+
+// Single producer (the owning thread), single consumer (the logger thread).
+typedef struct LogRing
+{
+    LogRecord records[LOG_RING_SIZE];
+    u32       head; // next slot the producer writes
+    u32       tail; // next slot the consumer reads
+    u32       dropped; // records lost because the ring was full
+    u32       in_use; // owned by a live thread
+    struct LogRing* next;
+} LogRing;
+
+static LogRing*       rings; // every ring ever created, pushed lock-free
+static __thread LogRing* my_ring;
+static pthread_key_t  ring_key;
+static pthread_once_t started = PTHREAD_ONCE_INIT;
+static pthread_t      logger;
+static u32            stopping;
+
+//------------------------------------------------------------------------------
+//                               Formatting
+//------------------------------------------------------------------------------
+
+static char* level_colors[] = { "\033[38;2;110;110;110;m", "\033[38;2;110;110;110;m", "\033[33m", "\033[31m" };
+
+// printf for arguments that were all widened to u64. Each conversion is
+// handed to snprintf on its own with the argument cast back to what it asks for.
+static void format(char* out, s32 size, char* fmt, u64* args, s32 nargs)
+{
+    s32 len = 0, arg = 0;
+    while (*fmt && len < size - 1) {
+        if (*fmt != '%') {
+            out[len++] = *fmt++;
+            continue;
+        }
+        if (fmt[1] == '%') {
+            out[len++] = '%';
+            fmt += 2;
+            continue;
+        }
+
+        // Copy flags, width and precision, and drop the length modifier.
+        char spec[32];
+        s32  n    = 0;
+        spec[n++] = *fmt++;
+        while (*fmt && strchr("-+ #0123456789.", *fmt) && n < 24)
+            spec[n++] = *fmt++;
+        while (*fmt && strchr("hlzjt", *fmt))
+            ++fmt;
+        char conv = *fmt ? *fmt++ : 's';
+
+        u64 value = arg < nargs ? args[arg++] : 0;
+        s32 room  = size - len;
+        s32 wrote = 0;
+        switch (conv) {
+        case 'd':
+        case 'i':
+            memcpy(spec + n, "ll", 2);
+            spec[n + 2] = conv;
+            spec[n + 3] = 0;
+            wrote       = snprintf(out + len, room, spec, (long long)value);
+            break;
+        case 'u':
+        case 'x':
+        case 'X':
+        case 'o':
+            memcpy(spec + n, "ll", 2);
+            spec[n + 2] = conv;
+            spec[n + 3] = 0;
+            wrote       = snprintf(out + len, room, spec, (unsigned long long)value);
+            break;
+        case 'c':
+            spec[n]     = conv;
+            spec[n + 1] = 0;
+            wrote       = snprintf(out + len, room, spec, (int)value);
+            break;
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G': {
+            union {
+                u64 u;
+                f64 f;
+            } bits;
+            bits.u      = value;
+            spec[n]     = conv;
+            spec[n + 1] = 0;
+            wrote       = snprintf(out + len, room, spec, bits.f);
+        } break;
+        case 'p':
+            spec[n]     = conv;
+            spec[n + 1] = 0;
+            wrote       = snprintf(out + len, room, spec, (void*)(uintptr_t)value);
+            break;
+        default:
+            spec[n]     = 's';
+            spec[n + 1] = 0;
+            wrote       = snprintf(out + len, room, spec, value ? (char*)(uintptr_t)value : "(null)");
+            break;
+        }
+        len += wrote < room ? wrote : room - 1;
+    }
+    out[len] = 0;
+}
+
+static void print(LogRecord* r)
+{
+    char line[LOG_LINE_SIZE];
+    format(line, sizeof(line), r->site->fmt, r->args, r->nargs);
+    fputs(level_colors[r->site->level], stdout);
+    fputs(line, stdout);
+    if (r->suppressed) printf(" (%u similar messages suppressed)", r->suppressed);
+    puts("\033[0m");
+}
+
+//------------------------------------------------------------------------------
+//                               Logger Thread
+//------------------------------------------------------------------------------
+
+static s32 drain(void)
+{
+    s32 count = 0;
+    for (LogRing* ring = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); ring; ring = ring->next) {
+        u32 head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        u32 tail = ring->tail;
+        for (; tail != head; ++tail, ++count)
+            print(&ring->records[tail & (LOG_RING_SIZE - 1)]);
+        __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+
+        u32 dropped = __atomic_exchange_n(&ring->dropped, 0, __ATOMIC_RELAXED);
+        if (dropped) printf("%s%u log messages dropped, ring buffer full\033[0m\n", level_colors[2], dropped);
+    }
+    if (count) fflush(stdout);
+    return count;
+}
+
+static void* run(void* arg)
+{
+    (void)arg;
+    struct timespec idle = { 0, 2000000 };
+    while (!__atomic_load_n(&stopping, __ATOMIC_ACQUIRE))
+        if (!drain()) nanosleep(&idle, NULL);
+    drain();
+    return NULL;
+}
+
+static void stop(void)
+{
+    __atomic_store_n(&stopping, 1, __ATOMIC_RELEASE);
+    pthread_join(logger, NULL);
+}
+
+static void release(void* ring) { __atomic_store_n(&((LogRing*)ring)->in_use, 0, __ATOMIC_RELEASE); }
+
+static void start(void)
+{
+    pthread_key_create(&ring_key, release);
+    pthread_create(&logger, NULL, run, NULL);
+    atexit(stop);
+}
+
+void log_flush(void)
+{
+    // Only the logger thread consumes, so wait for it to catch up.
+    for (LogRing* ring = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); ring; ring = ring->next)
+        while (__atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) != __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE)) {
+            struct timespec wait = { 0, 100000 };
+            nanosleep(&wait, NULL);
+        }
+}
+
+//------------------------------------------------------------------------------
+//                               Producers
+//------------------------------------------------------------------------------
+
+static LogRing* acquireRing(void)
+{
+    pthread_once(&started, start);
+
+    // Reuse the ring of a thread that has exited, if there is one.
+    LogRing* ring = __atomic_load_n(&rings, __ATOMIC_ACQUIRE);
+    for (; ring; ring = ring->next) {
+        u32 free = 0;
+        if (__atomic_compare_exchange_n(&ring->in_use, &free, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) break;
+    }
+
+    if (!ring) {
+        ring         = xcalloc(1, sizeof(LogRing));
+        ring->in_use = 1;
+        ring->next   = __atomic_load_n(&rings, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&rings, &ring->next, ring, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+            continue;
+    }
+
+    pthread_setspecific(ring_key, ring);
+    return ring;
+}
+
+void log_write(LogSite* site, u64* args, s32 nargs)
+{
+    u64 now = get_time_ns();
+
+    // Rate limit per call site. Racing threads may let a message or two more
+    // through; that is fine for a limiter.
+    if (now - __atomic_load_n(&site->window_start, __ATOMIC_RELAXED) >= 1000000000ull) {
+        __atomic_store_n(&site->window_start, now, __ATOMIC_RELAXED);
+        __atomic_store_n(&site->count, 0, __ATOMIC_RELAXED);
+    }
+    if (__atomic_fetch_add(&site->count, 1, __ATOMIC_RELAXED) >= LOG_RATE_LIMIT) {
+        __atomic_fetch_add(&site->suppressed, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    LogRing* ring = my_ring;
+    if (!ring) ring = my_ring = acquireRing();
+
+    u32 head = ring->head;
+    if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == LOG_RING_SIZE) {
+        __atomic_fetch_add(&ring->dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    LogRecord* r  = &ring->records[head & (LOG_RING_SIZE - 1)];
+    r->site       = site;
+    r->time_ns    = now;
+    r->suppressed = __atomic_exchange_n(&site->suppressed, 0, __ATOMIC_RELAXED);
+    r->nargs      = nargs < LOG_MAX_ARGS ? nargs : LOG_MAX_ARGS;
+    memcpy(r->args, args, r->nargs * sizeof(u64));
+
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
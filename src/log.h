@@ -0,0 +1,100 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include "typedefs.h"
+
+//------------------------------------------------------------------------------
+//                               Asynchronous Logging
+//------------------------------------------------------------------------------
+
+// Messages are written as fixed-size binary records into a ring buffer owned
+// by the calling thread and formatted on a background thread, so logging
+// from the emulation loop never touches stdio.
+//
+// Arguments are stored as u64. Strings must be cast with LOG_STR() and must
+// outlive the message (string literals, in practice); floating point values
+// must go through LOG_F64().
+
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO 1
+#define LOG_LEVEL_WARNING 2
+#define LOG_LEVEL_ERROR 3
+#define LOG_LEVEL_NONE 4
+
+// Calls below this level are compiled out completely.
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+#define LOG_MAX_ARGS 4
+
+// At most this many messages per call site per second; the rest are counted
+// and reported with the next message that gets through.
+#define LOG_RATE_LIMIT 10
+
+typedef struct
+{
+    char* fmt;
+    u8    level;
+    u64   window_start;
+    u32   count; // messages in the current window
+    u32   suppressed;
+} LogSite;
+
+typedef struct
+{
+    LogSite* site;
+    u64      time_ns;
+    u32      suppressed; // messages dropped at this site before this one
+    u32      nargs;
+    u64      args[LOG_MAX_ARGS];
+} LogRecord;
+
+void log_write(LogSite* site, u64* args, s32 nargs);
+
+// Formats everything queued so far. Also runs at exit.
+void log_flush(void);
+
+#define LOG_STR(s) ((u64)(uintptr_t)(s))
+static inline u64 LOG_F64(f64 x)
+{
+    union {
+        f64 f;
+        u64 u;
+    } bits;
+    bits.f = x;
+    return bits.u;
+}
+
+#define LOG_AT(lvl, fmt, ...)                                                                                          \
+    do {                                                                                                               \
+        static LogSite log_site_ = { fmt, lvl, 0, 0, 0 };                                                              \
+        u64            log_args_[] = { 0, ##__VA_ARGS__ };                                                             \
+        log_write(&log_site_, log_args_ + 1, sizeof(log_args_) / sizeof(u64) - 1);                                     \
+    } while (0)
+
+#if LOG_LEVEL <= LOG_LEVEL_DEBUG
+#define log_debug(...) LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define log_debug(...) ((void)0)
+#endif
+
+#if LOG_LEVEL <= LOG_LEVEL_INFO
+#define log_info(...) LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define log_info(...) ((void)0)
+#endif
+
+#if LOG_LEVEL <= LOG_LEVEL_WARNING
+#define log_warning(...) LOG_AT(LOG_LEVEL_WARNING, __VA_ARGS__)
+#else
+#define log_warning(...) ((void)0)
+#endif
+
+#if LOG_LEVEL <= LOG_LEVEL_ERROR
+#define log_error(...) LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define log_error(...) ((void)0)
+#endif
+
+#endif
@@ -0,0 +1,197 @@
+#include "opcode.h"
+#include <stdio.h> // snprintf
+
+//------------------------------------------------------------------------------
+//                               Opcode Table
+//------------------------------------------------------------------------------
+
+OpInfo op_info[OP_COUNT] = {
+    [OP_UNKNOWN]  = { "DW 0x%04X", ARGS_NONE, 0 },
+    [OP_CLS]      = { "CLS", ARGS_NONE, 0 },
+    [OP_RET]      = { "RET", ARGS_NONE, OPF_RETURN },
+    [OP_JP]       = { "JP 0x%03X", ARGS_NNN, OPF_JUMP },
+    [OP_CALL]     = { "CALL 0x%03X", ARGS_NNN, OPF_CALL },
+    [OP_SE_BYTE]  = { "SE V%X, 0x%02X", ARGS_X_NN, OPF_SKIP | OPF_PURE },
+    [OP_SNE_BYTE] = { "SNE V%X, 0x%02X", ARGS_X_NN, OPF_SKIP | OPF_PURE },
+    [OP_SE_REG]   = { "SE V%X, V%X", ARGS_X_Y, OPF_SKIP | OPF_PURE },
+    [OP_LD_BYTE]  = { "LD V%X, 0x%02X", ARGS_X_NN, OPF_PURE },
+    [OP_ADD_BYTE] = { "ADD V%X, 0x%02X", ARGS_X_NN, OPF_PURE },
+    [OP_LD_REG]   = { "LD V%X, V%X", ARGS_X_Y, OPF_PURE },
+    [OP_OR]       = { "OR V%X, V%X", ARGS_X_Y, OPF_PURE },
+    [OP_AND]      = { "AND V%X, V%X", ARGS_X_Y, OPF_PURE },
+    [OP_XOR]      = { "XOR V%X, V%X", ARGS_X_Y, OPF_PURE },
+    [OP_ADD_REG]  = { "ADD V%X, V%X", ARGS_X_Y, OPF_PURE },
+    [OP_SUB]      = { "SUB V%X, V%X", ARGS_X_Y, OPF_PURE },
+    [OP_SHR]      = { "SHR V%X, V%X", ARGS_X_Y, OPF_PURE },
+    [OP_SUBN]     = { "SUBN V%X, V%X", ARGS_X_Y, OPF_PURE },
+    [OP_SHL]      = { "SHL V%X, V%X", ARGS_X_Y, OPF_PURE },
+    [OP_SNE_REG]  = { "SNE V%X, V%X", ARGS_X_Y, OPF_SKIP | OPF_PURE },
+    [OP_LD_I]     = { "LD I, 0x%03X", ARGS_NNN, OPF_PURE | OPF_SETS_I },
+    [OP_JP_V0]    = { "JP V0, 0x%03X", ARGS_NNN, OPF_JUMP | OPF_INDIRECT },
+    [OP_JP_VX]    = { "JP V%X, 0x%03X", ARGS_X_NNN, OPF_JUMP | OPF_INDIRECT },
+    [OP_RND]      = { "RND V%X, 0x%02X", ARGS_X_NN, 0 },
+    [OP_DRW]      = { "DRW V%X, V%X, %X", ARGS_X_Y_N, OPF_READ_I },
+    [OP_SKP]      = { "SKP V%X", ARGS_X, OPF_SKIP | OPF_KEYS },
+    [OP_SKNP]     = { "SKNP V%X", ARGS_X, OPF_SKIP | OPF_KEYS },
+    [OP_LD_VX_DT] = { "LD V%X, DT", ARGS_X, OPF_PURE },
+    [OP_LD_KEY]   = { "LD V%X, K", ARGS_X, OPF_KEYS },
+    [OP_LD_DT]    = { "LD DT, V%X", ARGS_X, 0 },
+    [OP_LD_ST]    = { "LD ST, V%X", ARGS_X, 0 },
+    [OP_ADD_I]    = { "ADD I, V%X", ARGS_X, OPF_PURE | OPF_SETS_I },
+    [OP_LD_FONT]  = { "LD F, V%X", ARGS_X, OPF_PURE | OPF_SETS_I },
+    [OP_BCD]      = { "LD B, V%X", ARGS_X, OPF_WRITE_I },
+    [OP_STORE]    = { "LD [I], V%X", ARGS_X, OPF_WRITE_I | OPF_SETS_I },
+    [OP_LOAD]     = { "LD V%X, [I]", ARGS_X, OPF_READ_I | OPF_SETS_I },
+
+    [OP_SCD]        = { "SCD %X", ARGS_N, 0 },
+    [OP_SCR]        = { "SCR", ARGS_NONE, 0 },
+    [OP_SCL]        = { "SCL", ARGS_NONE, 0 },
+    [OP_EXIT]       = { "EXIT", ARGS_NONE, OPF_RETURN },
+    [OP_LOW]        = { "LOW", ARGS_NONE, 0 },
+    [OP_HIGH]       = { "HIGH", ARGS_NONE, 0 },
+    [OP_LD_HFONT]   = { "LD HF, V%X", ARGS_X, OPF_PURE | OPF_SETS_I },
+    [OP_SAVE_FLAGS] = { "LD R, V%X", ARGS_X, 0 },
+    [OP_LOAD_FLAGS] = { "LD V%X, R", ARGS_X, 0 },
+
+    [OP_SCU]   = { "SCU %X", ARGS_N, 0 },
+    [OP_PLANE] = { "PLANE %X", ARGS_X, 0 },
+    [OP_AUDIO] = { "AUDIO", ARGS_NONE, OPF_READ_I },
+    [OP_PITCH] = { "PITCH V%X", ARGS_X, 0 },
+};
+
+//------------------------------------------------------------------------------
+//                               Decoding
+//------------------------------------------------------------------------------
+
+// What each profile's interpreter was built with. These are the ISA_SCHIP,
+// ISA_XOCHIP and QUIRK_JUMP_VX settings chip8.c gives cycle.inl.
+typedef struct
+{
+    bool schip;
+    bool xochip;
+    bool jump_vx;
+} ProfileIsa;
+
+static ProfileIsa profile_isa[PROFILE_COUNT] = {
+    [PROFILE_MODERN] = { false, false, false },
+    [PROFILE_VIP]    = { false, false, false },
+    [PROFILE_CHIP48] = { false, false, true },
+    [PROFILE_SCHIP]  = { true, false, true },
+    [PROFILE_XOCHIP] = { true, true, false },
+};
+
+OpKind decodeOpcode(u16 opcode, QuirkProfile profile)
+{
+    ProfileIsa isa = profile_isa[profile];
+
+    // The masks below are the ones the interpreter switches on.
+    switch (opcode & 0xF000) {
+    case 0x0000:
+        if (!isa.schip) {
+            switch (opcode & 0x000F) {
+            case 0x0: return OP_CLS;
+            case 0xE: return OP_RET;
+            }
+            break;
+        }
+        switch (opcode & 0x00FF) {
+        case 0x00E0: return OP_CLS;
+        case 0x00EE: return OP_RET;
+        case 0x00FB: return OP_SCR;
+        case 0x00FC: return OP_SCL;
+        case 0x00FD: return OP_EXIT;
+        case 0x00FE: return OP_LOW;
+        case 0x00FF: return OP_HIGH;
+        }
+        if ((opcode & 0xFFF0) == 0x00C0) return OP_SCD;
+        if (isa.xochip && (opcode & 0xFFF0) == 0x00D0) return OP_SCU;
+        break;
+    case 0x1000: return OP_JP;
+    case 0x2000: return OP_CALL;
+    case 0x3000: return OP_SE_BYTE;
+    case 0x4000: return OP_SNE_BYTE;
+    case 0x5000: return OP_SE_REG;
+    case 0x6000: return OP_LD_BYTE;
+    case 0x7000: return OP_ADD_BYTE;
+    case 0x8000:
+        switch (OP_N(opcode)) {
+        case 0x0: return OP_LD_REG;
+        case 0x1: return OP_OR;
+        case 0x2: return OP_AND;
+        case 0x3: return OP_XOR;
+        case 0x4: return OP_ADD_REG;
+        case 0x5: return OP_SUB;
+        case 0x6: return OP_SHR;
+        case 0x7: return OP_SUBN;
+        case 0xE: return OP_SHL;
+        }
+        break;
+    case 0x9000: return OP_SNE_REG;
+    case 0xA000: return OP_LD_I;
+    case 0xB000: return isa.jump_vx ? OP_JP_VX : OP_JP_V0;
+    case 0xC000: return OP_RND;
+    case 0xD000: return OP_DRW;
+    case 0xE000:
+        switch (OP_NN(opcode)) {
+        case 0x9E: return OP_SKP;
+        case 0xA1: return OP_SKNP;
+        }
+        break;
+    case 0xF000:
+        switch (OP_NN(opcode)) {
+        case 0x01: return isa.xochip ? OP_PLANE : OP_UNKNOWN;
+        case 0x02: return isa.xochip ? OP_AUDIO : OP_UNKNOWN;
+        case 0x07: return OP_LD_VX_DT;
+        case 0x0A: return OP_LD_KEY;
+        case 0x15: return OP_LD_DT;
+        case 0x18: return OP_LD_ST;
+        case 0x1E: return OP_ADD_I;
+        case 0x29: return OP_LD_FONT;
+        case 0x30: return isa.schip ? OP_LD_HFONT : OP_UNKNOWN;
+        case 0x3A: return isa.xochip ? OP_PITCH : OP_UNKNOWN;
+        case 0x33: return OP_BCD;
+        case 0x55: return OP_STORE;
+        case 0x65: return OP_LOAD;
+        case 0x75: return isa.schip ? OP_SAVE_FLAGS : OP_UNKNOWN;
+        case 0x85: return isa.schip ? OP_LOAD_FLAGS : OP_UNKNOWN;
+        }
+        break;
+    }
+    return OP_UNKNOWN;
+}
+
+void disassemble(u16 opcode, QuirkProfile profile, char* buf, s32 size)
+{
+    OpKind  kind = decodeOpcode(opcode, profile);
+    OpInfo* info = &op_info[kind];
+
+    if (kind == OP_UNKNOWN) {
+        snprintf(buf, size, info->format, opcode);
+        return;
+    }
+
+    switch (info->args) {
+    case ARGS_NONE: snprintf(buf, size, "%s", info->format); break;
+    case ARGS_N: snprintf(buf, size, info->format, OP_N(opcode)); break;
+    case ARGS_NNN: snprintf(buf, size, info->format, OP_NNN(opcode)); break;
+    case ARGS_X_NNN: snprintf(buf, size, info->format, OP_X(opcode), OP_NNN(opcode)); break;
+    case ARGS_X: snprintf(buf, size, info->format, OP_X(opcode)); break;
+    case ARGS_X_NN: snprintf(buf, size, info->format, OP_X(opcode), OP_NN(opcode)); break;
+    case ARGS_X_Y: snprintf(buf, size, info->format, OP_X(opcode), OP_Y(opcode)); break;
+    case ARGS_X_Y_N: snprintf(buf, size, info->format, OP_X(opcode), OP_Y(opcode), OP_N(opcode)); break;
+    }
+}
+
+s32 opcodeMemorySpan(u16 opcode, QuirkProfile profile)
+{
+    switch (decodeOpcode(opcode, profile)) {
+    case OP_DRW:
+        if (OP_N(opcode)) return OP_N(opcode);
+        return profile_isa[profile].schip ? 32 : 0; // DXY0 is 16x16
+    case OP_BCD: return 3;
+    case OP_AUDIO: return 16;
+    case OP_STORE:
+    case OP_LOAD: return OP_X(opcode) + 1;
+    }
+    return 0;
+}
@@ -0,0 +1,126 @@
+#ifndef OPCODE_H
+#define OPCODE_H
+
+#include "typedefs.h"
+
+//------------------------------------------------------------------------------
+//                               Opcode Decoding
+//------------------------------------------------------------------------------
+
+// Interpreter variants for the behaviours CHIP-8 implementations disagree on.
+// They also differ in which opcodes exist, so decoding depends on them too.
+typedef enum {
+    PROFILE_MODERN,
+    PROFILE_VIP,
+    PROFILE_CHIP48,
+    PROFILE_SCHIP,
+    PROFILE_XOCHIP,
+    PROFILE_COUNT,
+} QuirkProfile;
+
+typedef enum {
+    OP_UNKNOWN,
+    OP_CLS, // 00E0 (0NN0 without the extensions)
+    OP_RET, // 00EE (0NNE without the extensions)
+    OP_JP, // 1NNN
+    OP_CALL, // 2NNN
+    OP_SE_BYTE, // 3XNN
+    OP_SNE_BYTE, // 4XNN
+    OP_SE_REG, // 5XY0, and 5XYN for any N
+    OP_LD_BYTE, // 6XNN
+    OP_ADD_BYTE, // 7XNN
+    OP_LD_REG, // 8XY0
+    OP_OR, // 8XY1
+    OP_AND, // 8XY2
+    OP_XOR, // 8XY3
+    OP_ADD_REG, // 8XY4
+    OP_SUB, // 8XY5
+    OP_SHR, // 8XY6
+    OP_SUBN, // 8XY7
+    OP_SHL, // 8XYE
+    OP_SNE_REG, // 9XY0, and 9XYN for any N
+    OP_LD_I, // ANNN
+    OP_JP_V0, // BNNN
+    OP_JP_VX, // BXNN on CHIP-48 and SUPER-CHIP
+    OP_RND, // CXNN
+    OP_DRW, // DXYN
+    OP_SKP, // EX9E
+    OP_SKNP, // EXA1
+    OP_LD_VX_DT, // FX07
+    OP_LD_KEY, // FX0A
+    OP_LD_DT, // FX15
+    OP_LD_ST, // FX18
+    OP_ADD_I, // FX1E
+    OP_LD_FONT, // FX29
+    OP_BCD, // FX33
+    OP_STORE, // FX55
+    OP_LOAD, // FX65
+
+    // SUPER-CHIP
+    OP_SCD, // 00CN
+    OP_SCR, // 00FB
+    OP_SCL, // 00FC
+    OP_EXIT, // 00FD
+    OP_LOW, // 00FE
+    OP_HIGH, // 00FF
+    OP_LD_HFONT, // FX30
+    OP_SAVE_FLAGS, // FX75
+    OP_LOAD_FLAGS, // FX85
+
+    // XO-CHIP
+    OP_SCU, // 00DN
+    OP_PLANE, // FN01
+    OP_AUDIO, // F002
+    OP_PITCH, // FX3A
+    OP_COUNT,
+} OpKind;
+
+typedef enum {
+    ARGS_NONE,
+    ARGS_N,
+    ARGS_NNN,
+    ARGS_X_NNN,
+    ARGS_X,
+    ARGS_X_NN,
+    ARGS_X_Y,
+    ARGS_X_Y_N,
+} OpArgs;
+
+// Properties of an instruction that matter to code outside the interpreter.
+enum {
+    OPF_JUMP     = 1 << 0, // control goes to NNN and never falls through
+    OPF_CALL     = 1 << 1, // control goes to NNN and comes back to the next instruction
+    OPF_RETURN   = 1 << 2, // control never falls through (00EE, 00FD)
+    OPF_SKIP     = 1 << 3, // may skip the next instruction
+    OPF_INDIRECT = 1 << 4, // target depends on a register
+    OPF_PURE     = 1 << 5, // reads only V, I and DT, and writes only V and I
+    OPF_READ_I   = 1 << 6, // reads memory at I
+    OPF_WRITE_I  = 1 << 7, // writes memory at I
+    OPF_SETS_I   = 1 << 8,
+    OPF_KEYS     = 1 << 9,
+};
+
+typedef struct
+{
+    char*  format; // printf format for the disassembly, taking the arguments in 'args' order
+    OpArgs args;
+    u32    flags;
+} OpInfo;
+
+extern OpInfo op_info[OP_COUNT];
+
+#define OP_X(op) (((op)&0x0F00) >> 8)
+#define OP_Y(op) (((op)&0x00F0) >> 4)
+#define OP_N(op) ((op)&0x000F)
+#define OP_NN(op) ((op)&0x00FF)
+#define OP_NNN(op) ((op)&0x0FFF)
+
+// Decodes the way the interpreter for 'profile' in cycle.inl executes, so
+// that the two always agree on what an opcode is.
+OpKind decodeOpcode(u16 opcode, QuirkProfile profile);
+void   disassemble(u16 opcode, QuirkProfile profile, char* buf, s32 size);
+
+// Number of bytes at I the instruction reads or writes, for one bitplane.
+s32 opcodeMemorySpan(u16 opcode, QuirkProfile profile);
+
+#endif
@@ -0,0 +1,66 @@
+#include "pacer.h"
+#include "utility.h"
+#include <math.h> // sqrt
+#include <string.h> // memset
+
+#define SPIN_MIN_NS 50000
+#define SPIN_MAX_NS 2000000
+
+void pacerInit(Pacer* p, u32 hz)
+{
+    memset(p, 0, sizeof(Pacer));
+    p->period_ns   = 1000000000ull / hz;
+    p->deadline_ns = get_time_ns() + p->period_ns;
+    p->spin_ns     = SPIN_MAX_NS / 2;
+}
+
+u64 pacerRemaining(Pacer* p)
+{
+    u64 now = get_time_ns();
+    return p->deadline_ns > now ? p->deadline_ns - now : 0;
+}
+
+void pacerWait(Pacer* p)
+{
+    u64 now = get_time_ns();
+
+    if (p->deadline_ns > now + p->spin_ns) {
+        u64 target = p->deadline_ns - p->spin_ns;
+        sleep_until_ns(target);
+        now = get_time_ns();
+
+        // Keep the spin window at about twice the typical oversleep.
+        u64 over   = now > target ? now - target : 0;
+        u64 wanted = over * 2;
+        if (wanted < SPIN_MIN_NS) wanted = SPIN_MIN_NS;
+        if (wanted > SPIN_MAX_NS) wanted = SPIN_MAX_NS;
+        p->spin_ns = (p->spin_ns * 7 + wanted) / 8;
+    }
+
+    while (now < p->deadline_ns)
+        now = get_time_ns();
+
+    u64 late = now - p->deadline_ns;
+    ++p->frames;
+    p->late_sum += late;
+    p->late_sum_sq += (f64)late * late;
+    if (late > p->late_max) p->late_max = late;
+
+    // After a stall (a debugger prompt, a suspended process) start over from
+    // now rather than rushing through the missed frames.
+    if (late >= p->period_ns) {
+        ++p->missed;
+        p->deadline_ns = now;
+    }
+    p->deadline_ns += p->period_ns;
+}
+
+void pacerReport(Pacer* p)
+{
+    if (p->frames == 0) return;
+    f64 mean   = p->late_sum / p->frames;
+    f64 stddev = sqrt(fmax(0.0, p->late_sum_sq / p->frames - mean * mean));
+    info("Frame pacing over %llu frames: jitter avg %.1f us, stddev %.1f us, max %.1f us, %llu missed deadlines",
+        (unsigned long long)p->frames, mean / 1.0e3, stddev / 1.0e3, p->late_max / 1.0e3,
+        (unsigned long long)p->missed);
+}
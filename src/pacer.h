@@ -0,0 +1,38 @@
+#ifndef PACER_H
+#define PACER_H
+
+#include "typedefs.h"
+
+//------------------------------------------------------------------------------
+//                               Frame Pacing
+//------------------------------------------------------------------------------
+
+// Sleeps between frames on the monotonic clock. The bulk of the wait is a
+// real sleep; only the last 'spin_ns' before the deadline is spent spinning,
+// which hides the scheduler's wake-up latency. 'spin_ns' follows how late
+// sleeps have actually been waking up.
+typedef struct
+{
+    u64 period_ns;
+    u64 deadline_ns; // when the next frame is due
+    u64 spin_ns;
+
+    // Lateness of each frame start relative to its deadline.
+    u64 frames;
+    f64 late_sum;
+    f64 late_sum_sq;
+    u64 late_max;
+    u64 missed; // deadlines overrun by a whole frame or more
+} Pacer;
+
+void pacerInit(Pacer* p, u32 hz);
+
+// Nanoseconds left until the next deadline, 0 if it has passed.
+u64 pacerRemaining(Pacer* p);
+
+// Waits for the next deadline and moves it one period ahead.
+void pacerWait(Pacer* p);
+
+void pacerReport(Pacer* p);
+
+#endif
@@ -0,0 +1,323 @@
+#include "trace.h"
+#include "chip8.h"
+#include "log.h"
+#include "opcode.h"
+#include "utility.h"
+#include <fcntl.h> // open
+#include <stdio.h> // printf
+#include <stdlib.h> // free, strtoul
+#include <string.h> // memcpy, memcmp
+#include <strings.h> // strcasecmp
+#include <sys/mman.h> // mmap
+#include <sys/stat.h> // fstat
+#include <unistd.h> // ftruncate, close
+
+#define TRACE_RING_SIZE 4096 // records
+#define TRACE_MAP_CHUNK (16 << 20) // the file grows this many bytes at a time
+
+static TraceRecord* records(TraceHeader* h) { return (TraceRecord*)(h + 1); }
+
+//------------------------------------------------------------------------------
+//                               Recording
+//------------------------------------------------------------------------------
+
+static void remap(Tracer* t, u64 size)
+{
+    if (t->map) munmap(t->map, t->mapped);
+    if (ftruncate(t->fd, size) != 0) error("Could not grow the trace file");
+    t->map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, t->fd, 0);
+    if (t->map == MAP_FAILED) error("Could not map the trace file");
+    t->mapped = size;
+}
+
+static void flush(Tracer* t)
+{
+    if (!t->pending) return;
+
+    u64 count = t->map->count;
+    u64 need  = sizeof(TraceHeader) + (count + t->pending) * sizeof(TraceRecord);
+    if (need > t->mapped) remap(t, (need + TRACE_MAP_CHUNK - 1) / TRACE_MAP_CHUNK * TRACE_MAP_CHUNK);
+
+    memcpy(records(t->map) + count, t->ring, t->pending * sizeof(TraceRecord));
+    t->map->count = count + t->pending;
+    t->pending    = 0;
+}
+
+bool traceAttach(Chip8* c8, char* path)
+{
+    s32 fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return false;
+
+    Tracer* t = xcalloc(1, sizeof(Tracer));
+    t->ring   = xmalloc(TRACE_RING_SIZE * sizeof(TraceRecord));
+    t->fd     = fd;
+    remap(t, TRACE_MAP_CHUNK);
+    memcpy(t->map->magic, TRACE_MAGIC, 4);
+    t->map->version = TRACE_VERSION;
+    t->map->profile = c8->profile;
+    t->map->count   = 0;
+
+    c8->tracer = t;
+    return true;
+}
+
+// Number of non-zero bytes in 'x'.
+static s32 bytesSet(u64 x)
+{
+    x |= x >> 4;
+    x |= x >> 2;
+    x |= x >> 1;
+    return __builtin_popcountll(x & 0x0101010101010101ull);
+}
+
+// Appends the record for the instruction at 'pc', given the registers as
+// they were before it ran.
+static void record(Chip8* c8, u16 pc, u64 before[2], u16 I, u8 dt, u8 st)
+{
+    Tracer* t = c8->tracer;
+
+    // Find the changed registers eight at a time. The lowest address is
+    // the lowest byte on the little endian hosts this runs on.
+    u64 after[2];
+    memcpy(after, c8->V, 16);
+    u64 lo = before[0] ^ after[0], hi = before[1] ^ after[1];
+
+    TraceRecord* r = &t->ring[t->pending++];
+    r->cycle       = c8->cycles;
+    r->pc          = pc;
+    r->opcode      = c8->opcode;
+    r->changed     = bytesSet(lo) + bytesSet(hi) + (I != c8->I) + (dt != c8->delay_timer) + (st != c8->sound_timer);
+
+    if (lo)
+        r->reg = __builtin_ctzll(lo) / 8;
+    else if (hi)
+        r->reg = 8 + __builtin_ctzll(hi) / 8;
+    else if (I != c8->I)
+        r->reg = TRACE_REG_I;
+    else if (dt != c8->delay_timer)
+        r->reg = TRACE_REG_DT;
+    else if (st != c8->sound_timer)
+        r->reg = TRACE_REG_ST;
+    else
+        r->reg = TRACE_REG_NONE;
+
+    switch (r->reg) {
+    case TRACE_REG_I: r->value = c8->I; break;
+    case TRACE_REG_DT: r->value = c8->delay_timer; break;
+    case TRACE_REG_ST: r->value = c8->sound_timer; break;
+    case TRACE_REG_NONE: r->value = 0; break;
+    default: r->value = c8->V[r->reg]; break;
+    }
+
+    if (t->pending == TRACE_RING_SIZE) flush(t);
+}
+
+void traceStep(Chip8* c8)
+{
+    u16 pc = c8->pc;
+    u16 I  = c8->I;
+    u8  dt = c8->delay_timer, st = c8->sound_timer;
+    u64 before[2];
+    memcpy(before, c8->V, 16);
+
+    c8->step(c8);
+
+    // An FX0A that parks is recorded by traceWake() once it completes, and a
+    // fault or unknown opcode stops before the instruction does anything.
+    if (c8->state == CHIP8_WAIT_KEY || c8->state == CHIP8_FAULT || c8->state == CHIP8_BREAK) return;
+    record(c8, pc, before, I, dt, st);
+}
+
+void traceWake(Chip8* c8, u8 old)
+{
+    u64 before[2];
+    memcpy(before, c8->V, 16);
+    ((u8*)before)[c8->wait_reg] = old;
+
+    record(c8, c8->pc - 2, before, c8->I, c8->delay_timer, c8->sound_timer);
+}
+
+s32 traceRunCycles(Chip8* c8, s32 budget)
+{
+    while (budget > 0) {
+        if (c8->state == CHIP8_IDLE) c8->state = CHIP8_RUNNING; // every instruction is recorded, none skipped
+        if (c8->state != CHIP8_RUNNING) break;
+
+        traceStep(c8);
+        --budget;
+    }
+
+    flush(c8->tracer);
+    return budget;
+}
+
+void traceDetach(Chip8* c8)
+{
+    Tracer* t = c8->tracer;
+    if (!t) return;
+
+    flush(t);
+    u64 count = t->map->count;
+    munmap(t->map, t->mapped);
+    if (ftruncate(t->fd, sizeof(TraceHeader) + count * sizeof(TraceRecord)) != 0)
+        log_warning("Could not trim the trace file");
+    close(t->fd);
+
+    log_info("Trace: %llu instructions recorded", (unsigned long long)count);
+
+    c8->tracer = NULL;
+    free(t->ring);
+    free(t);
+}
+
+//------------------------------------------------------------------------------
+//                               Decoding
+//------------------------------------------------------------------------------
+
+// Maps a trace file read-only. Returns NULL, having printed why, if it is not one.
+static TraceHeader* openTrace(char* path, u64* count, u64* size)
+{
+    s32 fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        warning("Could not open %s", path);
+        return NULL;
+    }
+    struct stat st;
+    fstat(fd, &st);
+    *size = st.st_size;
+
+    TraceHeader* h = *size >= sizeof(TraceHeader) ? mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (h == MAP_FAILED || memcmp(h->magic, TRACE_MAGIC, 4) != 0 || h->version != TRACE_VERSION) {
+        if (h != MAP_FAILED) munmap(h, *size);
+        warning("%s is not a trace file", path);
+        return NULL;
+    }
+
+    // A trace that was never closed has a file longer than its records.
+    u64 room = (*size - sizeof(TraceHeader)) / sizeof(TraceRecord);
+    *count   = h->count < room ? h->count : room;
+    return h;
+}
+
+static char* reg_names[] = { "V0", "V1", "V2", "V3", "V4", "V5", "V6", "V7", "V8", "V9", "VA", "VB", "VC", "VD", "VE",
+    "VF", "I", "DT", "ST" };
+
+static void printRecord(char* prefix, u64 index, TraceRecord* r, QuirkProfile profile)
+{
+    char text[32];
+    disassemble(r->opcode, profile, text, sizeof(text));
+    printf("%s%8llu  cycle %-10llu 0x%03X  %04X  %-16s", prefix, (unsigned long long)index,
+        (unsigned long long)r->cycle, r->pc, r->opcode, text);
+    if (r->reg <= TRACE_REG_ST) printf("%s = 0x%X", reg_names[r->reg], r->value);
+    if (r->changed > 1) printf(" (+%d)", r->changed - 1);
+    printf("\n");
+}
+
+typedef struct
+{
+    u64 pc_lo, pc_hi;
+    u64 cycle_lo, cycle_hi;
+    s32 reg; // -1 for any
+    u16 op_mask, op_value;
+} Filter;
+
+static bool parseRange(char* text, u64* lo, u64* hi)
+{
+    char* end;
+    *lo = strtoull(text, &end, 0);
+    if (end == text) return false;
+    *hi = *lo;
+    if (*end == '-') *hi = strtoull(end + 1, &end, 0);
+    return *end == 0;
+}
+
+static bool parseFilter(Filter* f, char* text)
+{
+    if (strncmp(text, "pc=", 3) == 0) return parseRange(text + 3, &f->pc_lo, &f->pc_hi);
+    if (strncmp(text, "cycle=", 6) == 0) return parseRange(text + 6, &f->cycle_lo, &f->cycle_hi);
+    if (strncmp(text, "reg=", 4) == 0) {
+        for (s32 i = 0; i <= TRACE_REG_ST; ++i)
+            if (strcasecmp(text + 4, reg_names[i]) == 0) f->reg = i;
+        return f->reg >= 0;
+    }
+    if (strncmp(text, "op=", 3) == 0 && strlen(text) == 7) {
+        for (s32 i = 0; i < 4; ++i) {
+            char c     = text[3 + i];
+            s32  shift = 12 - 4 * i;
+            if (c == 'X' || c == 'x') continue;
+            char  digit[2] = { c, 0 };
+            char* end;
+            u16   v = strtoul(digit, &end, 16);
+            if (*end) return false;
+            f->op_mask |= 0xF << shift;
+            f->op_value |= v << shift;
+        }
+        return true;
+    }
+    return false;
+}
+
+s32 traceDump(char* path, char** filters, s32 count)
+{
+    Filter f = { 0, 0xFFF, 0, ~0ull, -1, 0, 0 };
+    for (s32 i = 0; i < count; ++i)
+        if (!parseFilter(&f, filters[i])) {
+            warning("Bad filter '%s', expected pc=LO-HI, cycle=LO-HI, reg=VX|I|DT|ST or op=DXXX", filters[i]);
+            return 1;
+        }
+
+    u64          n, size;
+    TraceHeader* h = openTrace(path, &n, &size);
+    if (!h) return 1;
+
+    TraceRecord* r = records(h);
+    for (u64 i = 0; i < n; ++i, ++r) {
+        if (r->pc < f.pc_lo || r->pc > f.pc_hi) continue;
+        if (r->cycle < f.cycle_lo || r->cycle > f.cycle_hi) continue;
+        if (f.reg >= 0 && r->reg != f.reg) continue;
+        if ((r->opcode & f.op_mask) != f.op_value) continue;
+        printRecord("", i, r, h->profile);
+    }
+
+    munmap(h, size);
+    return 0;
+}
+
+#define DIFF_CONTEXT 8
+
+s32 traceDiff(char* a, char* b)
+{
+    u64          na, nb, size_a, size_b;
+    TraceHeader* ha = openTrace(a, &na, &size_a);
+    TraceHeader* hb = ha ? openTrace(b, &nb, &size_b) : NULL;
+    if (!hb) {
+        if (ha) munmap(ha, size_a);
+        return 2;
+    }
+
+    TraceRecord* ra = records(ha);
+    TraceRecord* rb = records(hb);
+    u64          n  = na < nb ? na : nb;
+    u64          i  = 0;
+    while (i < n && memcmp(&ra[i], &rb[i], sizeof(TraceRecord)) == 0)
+        ++i;
+
+    s32 status = 0;
+    if (i < n) {
+        printf("Traces diverge at record %llu:\n", (unsigned long long)i);
+        for (u64 k = i > DIFF_CONTEXT ? i - DIFF_CONTEXT : 0; k < i; ++k)
+            printRecord("  ", k, &ra[k], ha->profile);
+        printRecord("< ", i, &ra[i], ha->profile);
+        printRecord("> ", i, &rb[i], hb->profile);
+        status = 1;
+    } else if (na != nb) {
+        printf("Traces agree for %llu records, then %s ends\n", (unsigned long long)n, na < nb ? a : b);
+        status = 1;
+    } else
+        printf("Traces are identical, %llu records\n", (unsigned long long)n);
+
+    munmap(ha, size_a);
+    munmap(hb, size_b);
+    return status;
+}
@@ -0,0 +1,91 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "typedefs.h"
+
+struct Chip8;
+
+//------------------------------------------------------------------------------
+//                               Execution Trace
+//------------------------------------------------------------------------------
+
+// A trace file is a TraceHeader followed by one TraceRecord per executed
+// instruction. Records are collected in memory and copied into the mmap'd
+// file at the end of every frame, when the header count is updated too, so
+// a crash loses at most the frame in progress.
+
+#define TRACE_MAGIC "C8TR"
+#define TRACE_VERSION 2
+
+// Register numbers in TraceRecord.reg: 0-15 are V0-VF.
+#define TRACE_REG_I 16
+#define TRACE_REG_DT 17
+#define TRACE_REG_ST 18
+#define TRACE_REG_NONE 0xFF
+
+typedef struct
+{
+    char magic[4];
+    u16  version;
+    u16  profile; // QuirkProfile the machine ran, which decides how opcodes disassemble
+    u64  count; // records that follow
+} TraceHeader;
+
+typedef struct
+{
+    u64 cycle;
+    u16 pc;
+    u16 opcode;
+    u8  reg; // lowest numbered register the instruction changed
+    u8  changed; // how many registers it changed
+    u16 value; // new value of 'reg'
+} TraceRecord;
+
+typedef struct Tracer
+{
+    TraceRecord* ring;
+    u32          pending; // records in 'ring' not yet in the file
+
+    s32          fd;
+    TraceHeader* map; // the whole file, header first
+    u64          mapped; // bytes mapped
+} Tracer;
+
+// Starts recording every instruction the machine executes into 'path'.
+// Returns false if the file could not be created.
+bool traceAttach(struct Chip8* c8, char* path);
+
+// Runs up to 'budget' instructions, recording each, then writes the frame
+// out. Used by runFrame() in place of the plain loop while a tracer is
+// attached, including after the debugger has run part of the frame. Returns
+// the cycles left over when the machine stopped running.
+s32 traceRunCycles(struct Chip8* c8, s32 budget);
+
+// Runs and records a single instruction, for loops other than the one above
+// that execute instructions while a tracer is attached.
+void traceStep(struct Chip8* c8);
+
+// Records the FX0A that just finished when a key woke the machine up, which
+// is its only record however long it waited. 'old' is the value its register
+// held before.
+void traceWake(struct Chip8* c8, u8 old);
+
+// Writes out what is left, trims the file to its contents and closes it.
+void traceDetach(struct Chip8* c8);
+
+// Prints the records of a trace file that pass every filter:
+//
+//   pc=LO[-HI]      instruction address in range
+//   cycle=LO[-HI]   cycle in range
+//   reg=VX|I|DT|ST  the recorded change is to that register
+//   op=XXXX         opcode, with X matching any nibble in the mask form, e.g. op=DXXX
+//
+// Returns the process exit status.
+s32 traceDump(char* path, char** filters, s32 count);
+
+// Compares two trace files record by record and reports the first one where
+// they differ, with the records leading up to it. Returns the process exit
+// status: 0 if the traces are identical, 1 if they diverge.
+s32 traceDiff(char* a, char* b);
+
+#endif
@@ -14,6 +14,8 @@ typedef uint16_t u16;
 typedef uint32_t u32;
 typedef uint64_t u64;
 
+typedef unsigned __int128 u128;
+
 typedef float  f32;
 typedef double f64;
 
@@ -1,5 +1,6 @@
 #include "utility.h"
 #include <assert.h> // assert
+#include <errno.h> // EINTR
 #include <stdarg.h> // va_list, va_start, va_end
 #include <stdio.h> // printf, vprintf
 #include <stdlib.h> // malloc, realloc, calloc
@@ -79,7 +80,7 @@ char* get_file_path_from_directory(char* dir, char* filename)
     assert(len < 1000);
     memcpy(strbuf, dir, d_len); // copy dir into strbuf
     memcpy(strbuf + d_len, filename, f_len); // append filename
-    char* str = xmalloc(len + 1);
+    char* str = arena_alloc(temp_arena(), len + 1);
     memcpy(str, strbuf, len);
     str[len] = 0;
     return str;
@@ -93,7 +94,7 @@ char* get_file_extension(char* filename)
     while (filename[len - (++i)] != '.')
         continue;
     ++len; // skip the '.'
-    char* str = xmalloc(i + 1);
+    char* str = arena_alloc(temp_arena(), i + 1);
     memcpy(str, filename + len - i, i);
     str[i] = 0;
     return str;
@@ -106,7 +107,7 @@ char* remove_file_extension(char* filename)
     s64 i   = 0;
     while (filename[len - (++i)] != '.')
         continue;
-    char* str = xmalloc(len - i + 1);
+    char* str = arena_alloc(temp_arena(), len - i + 1);
     memcpy(str, filename, len - i);
     str[len-i] = 0;
     return str;
@@ -119,7 +120,7 @@ char* get_file_directory(char* filename)
     while (filename[--len] != '/')
         continue;
     ++len; // we preserve the '/'
-    char* str = xmalloc(len + 1);
+    char* str = arena_alloc(temp_arena(), len + 1);
     memcpy(str, filename, len);
     str[len] = 0;
     return str;
@@ -132,7 +133,7 @@ char* get_file_name(char* filename)
     while (filename[len - (++i)] != '/')
         continue;
     ++len; // skip the '/'
-    char* str = xmalloc(i + 1);
+    char* str = arena_alloc(temp_arena(), i + 1);
     memcpy(str, filename + len - i, i);
     str[i] = 0;
     return str;
@@ -166,7 +167,7 @@ char* get_file_content(char* filename)
         rewind(handler);
 
         // Allocate a string that can hold it all
-        buffer = (char*)xmalloc(sizeof(u8) * (string_size + 1));
+        buffer = (char*)arena_alloc(temp_arena(), sizeof(u8) * (string_size + 1));
 
         // Read it all in one operation
         read_size = fread(buffer, sizeof(u8), string_size, handler);
@@ -176,9 +177,8 @@ char* get_file_content(char* filename)
         buffer[string_size] = '\0';
 
         if (string_size != read_size) {
-            // Something went wrong, throw away the memory and set
-            // the buffer to NULL
-            free(buffer);
+            // Something went wrong, set the buffer to NULL. The memory
+            // goes back with the rest of the temporary scope.
             buffer = NULL;
         }
 
@@ -222,6 +222,74 @@ void* _realloc(void* ptr, s64 bytes, char* file, s32 line)
     return alloc;
 }
 
+//------------------------------------------------------------------------------
+//                               Arena Allocator
+//------------------------------------------------------------------------------
+
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+static __thread Arena temp;
+
+void* arena_alloc(Arena* a, s64 bytes)
+{
+    assert(bytes > 0);
+    bytes = (bytes + 15) & ~15;
+
+    ArenaBlock* b = a->current;
+    if (b && b->used + bytes <= b->size) {
+        void* p = b->data + b->used;
+        b->used += bytes;
+        return p;
+    }
+
+    // Move on to the next block kept from before a reset, if it is big enough,
+    // otherwise put a new one in front of it.
+    ArenaBlock* next = b ? b->next : a->first;
+    if (!next || next->size < bytes) {
+        s64         size = bytes > ARENA_BLOCK_SIZE ? bytes : ARENA_BLOCK_SIZE;
+        ArenaBlock* n    = xmalloc(sizeof(ArenaBlock) + size);
+        n->size          = size;
+        n->next          = next;
+        if (b)
+            b->next = n;
+        else
+            a->first = n;
+        next = n;
+    }
+
+    next->used = bytes;
+    a->current = next;
+    return next->data;
+}
+
+ArenaMark arena_mark(Arena* a)
+{
+    ArenaMark mark = { a->current, a->current ? a->current->used : 0 };
+    return mark;
+}
+
+void arena_reset(Arena* a, ArenaMark mark)
+{
+    a->current = mark.block;
+    if (mark.block) mark.block->used = mark.used;
+}
+
+void arena_free(Arena* a)
+{
+    for (ArenaBlock* b = a->first; b;) {
+        ArenaBlock* next = b->next;
+        free(b);
+        b = next;
+    }
+    a->first = a->current = NULL;
+}
+
+Arena* temp_arena(void) { return &temp; }
+
+ArenaMark temp_begin(void) { return arena_mark(&temp); }
+
+void temp_end(ArenaMark scope) { arena_reset(&temp, scope); }
+
 char* strf(char* fmt, ...)
 {
     assert(fmt);
@@ -230,7 +298,7 @@ char* strf(char* fmt, ...)
     s64 n = 1 + vsnprintf(0, 0, fmt, args);
     va_end(args);
 
-    char* str = xmalloc(n);
+    char* str = arena_alloc(temp_arena(), n);
 
     va_start(args, fmt);
     vsnprintf(str, n, fmt, args);
@@ -277,45 +345,40 @@ char* get_unique_color(void) { return get_next_color(); }
 //                               Timing Utility Functions
 //------------------------------------------------------------------------------
 
-/*
-author: jbenet
-os x, compile with: gcc -o testo test.c
-linux, compile with: gcc -o testo test.c -lrt
-*/
-
-#include <stdio.h>
-#include <sys/time.h>
 #include <time.h>
 
 #ifdef __MACH__
-#include <mach/clock.h>
-#include <mach/mach.h>
+#include <mach/mach_time.h>
 #endif
 
-f64 get_time(void)
+// Seconds on the same monotonic clock as get_time_ns(), for measuring intervals.
+f64 get_time(void) { return get_time_ns() / 1.0e9; }
+
+u64 get_time_ns(void)
 {
-    f64             ms;
-    time_t          s;
+#ifdef __MACH__ // mach_absolute_time is monotonic, but counts in timebase units
+    static mach_timebase_info_data_t timebase;
+    if (timebase.denom == 0) mach_timebase_info(&timebase);
+    return mach_absolute_time() * timebase.numer / timebase.denom;
+#else
     struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+}
 
-#ifdef __MACH__ // OS X does not have clock_gettime, use clock_get_time
-    clock_serv_t    cclock;
-    mach_timespec_t mts;
-    host_get_clock_service(mach_host_self(), CALENDAR_CLOCK, &cclock);
-    clock_get_time(cclock, &mts);
-    mach_port_deallocate(mach_task_self(), cclock);
-    ts.tv_sec  = mts.tv_sec;
-    ts.tv_nsec = mts.tv_nsec;
+void sleep_until_ns(u64 deadline)
+{
+#ifdef __MACH__ // no clock_nanosleep, so sleep for the relative amount
+    u64 now = get_time_ns();
+    if (deadline <= now) return;
+    struct timespec ts = { (deadline - now) / 1000000000ull, (deadline - now) % 1000000000ull };
+    nanosleep(&ts, NULL);
 #else
-    clock_gettime(CLOCK_REALTIME, &ts);
+    struct timespec ts = { deadline / 1000000000ull, deadline % 1000000000ull };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+        continue;
 #endif
-    s  = ts.tv_sec;
-    ms = ts.tv_nsec / 1.0e6;
-    if (ms > 999.0) {
-        ++s;
-        ms = 0.0;
-    }
-    return ms;
 }
 
 //------------------------------------------------------------------------------
@@ -323,7 +386,7 @@ f64 get_time(void)
 //------------------------------------------------------------------------------
 void utility_tests(void)
 {
-    // These leak memory.
+    ArenaMark scope = temp_begin();
 
     // get_file_directory
     assert(strcmp(get_file_directory("./b/m.thi"), "./b/") == 0);
@@ -340,4 +403,12 @@ void utility_tests(void)
     // get_file_path_from_directory
     assert(strcmp(get_file_path_from_directory("./b/", "test.thi"), "./b/test.thi") == 0);
     assert(strcmp(get_file_path_from_directory("./b/b/", "test.thi"), "./b/b/test.thi") == 0);
+
+    // arena: resetting reuses the same memory
+    ArenaMark inner = temp_begin();
+    char*     first = strf("%d", 1);
+    temp_end(inner);
+    assert(strf("%d", 2) == first);
+
+    temp_end(scope);
 }
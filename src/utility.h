@@ -15,6 +15,9 @@ void error(char* fmt, ...);
 //------------------------------------------------------------------------------
 //                               File Functions
 //------------------------------------------------------------------------------
+
+// The string returning helpers below allocate from the calling thread's
+// temporary arena; see temp_begin().
 char* get_file_path_from_directory(char* dir, char* filename);
 char* get_file_extension(char* filename);
 char* remove_file_extension(char* filename);
@@ -34,7 +37,51 @@ void* _realloc(void* ptr, s64 bytes, char* file, int line);
 #define xrealloc(n, m) _realloc(n, m, __FILE__, __LINE__)
 #define xcalloc(n, m) _calloc(n, m, __FILE__, __LINE__)
 
-char* strf(char* fmt, ...);
+//------------------------------------------------------------------------------
+//                               Arena Allocator
+//------------------------------------------------------------------------------
+
+// Bump allocator over a chain of xmalloc'd blocks. Resetting to a mark hands
+// back everything allocated since, but keeps the blocks for reuse, so a
+// loop that allocates the same amount every iteration stops calling malloc
+// after the first one.
+typedef struct ArenaBlock
+{
+    struct ArenaBlock* next;
+    s64                size;
+    s64                used;
+    s64                pad; // keeps 'data' 16 byte aligned
+    u8                 data[];
+} ArenaBlock;
+
+typedef struct
+{
+    ArenaBlock* first;
+    ArenaBlock* current; // NULL until the first allocation
+} Arena;
+
+typedef struct
+{
+    ArenaBlock* block;
+    s64         used;
+} ArenaMark;
+
+void*     arena_alloc(Arena* a, s64 bytes); // 16 byte aligned
+ArenaMark arena_mark(Arena* a);
+void      arena_reset(Arena* a, ArenaMark mark);
+void      arena_free(Arena* a); // gives the blocks back to the heap
+
+// Every thread has a temporary arena for short-lived strings:
+//
+//     ArenaMark scope = temp_begin();
+//     char*     path  = get_file_path_from_directory(dir, name);
+//     ...
+//     temp_end(scope); // 'path' is gone
+Arena*    temp_arena(void);
+ArenaMark temp_begin(void);
+void      temp_end(ArenaMark scope);
+
+char* strf(char* fmt, ...); // allocated from temp_arena()
 
 char* get_previous_color(void);
 char* get_next_color(void);
@@ -45,7 +92,9 @@ char* get_unique_color(void);
 //------------------------------------------------------------------------------
 //                               Timing Functions
 //------------------------------------------------------------------------------
-f64 get_time(void);
+f64  get_time(void);
+u64  get_time_ns(void); // monotonic, for measuring intervals
+void sleep_until_ns(u64 deadline); // on the get_time_ns() clock
 
 //------------------------------------------------------------------------------
 //                               Tests